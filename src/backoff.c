@@ -0,0 +1,33 @@
+/*
+ * backoff.c — see backoff.h.
+ */
+
+#include "backoff.h"
+
+void
+backoff_init(Backoff* backoff, guint base_ms, guint max_ms)
+{
+    /* At most G_MAXINT: doubling below it cannot wrap, and half the
+     * ceiling fits g_random_int_range() */
+    backoff->base_ms = CLAMP(base_ms, 1, G_MAXINT);
+    backoff->max_ms = CLAMP(max_ms, backoff->base_ms, G_MAXINT);
+    backoff->attempt = 0;
+}
+
+guint
+backoff_next_ms(Backoff* backoff)
+{
+    guint ceiling = backoff->base_ms;
+    for (guint i = 0; i < backoff->attempt && ceiling < backoff->max_ms; i++)
+        ceiling *= 2;
+    ceiling = MIN(ceiling, backoff->max_ms);
+    backoff->attempt++;
+
+    return ceiling / 2 + (guint)g_random_int_range(0, (gint32)(ceiling - ceiling / 2) + 1);
+}
+
+void
+backoff_reset(Backoff* backoff)
+{
+    backoff->attempt = 0;
+}
@@ -0,0 +1,27 @@
+/*
+ * backoff.h — jittered exponential backoff for signaling reconnects.
+ *
+ * Each failed attempt doubles the ceiling from base_ms up to max_ms; the
+ * delay is drawn uniformly from the upper half of it, so a fleet that lost
+ * the same signaling server does not come back in lockstep.
+ */
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <glib.h>
+
+typedef struct {
+    guint base_ms;
+    guint max_ms;
+    guint attempt;  /* failures since the last success */
+} Backoff;
+
+void backoff_init(Backoff* backoff, guint base_ms, guint max_ms);
+
+/* Delay before the next attempt; counts it as a failure. */
+guint backoff_next_ms(Backoff* backoff);
+
+/* Connected: the next outage starts from base_ms again. */
+void backoff_reset(Backoff* backoff);
+
+#endif /* BACKOFF_H */
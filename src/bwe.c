@@ -0,0 +1,72 @@
+/*
+ * bwe.c — see bwe.h.
+ */
+
+#include "bwe.h"
+
+#define LOSS_HIGH 0.10
+#define LOSS_LOW  0.02
+#define RTT_QUEUEING_FACTOR 2.0
+#define RTT_QUEUEING_FLOOR  0.1 /* s; below this RTT noise is not congestion */
+
+void
+bwe_init(BweController* bwe, guint min_kbps, guint max_kbps, guint start_kbps)
+{
+    bwe->min_kbps = min_kbps;
+    bwe->max_kbps = MAX(max_kbps, min_kbps);
+    bwe->target_kbps = CLAMP(start_kbps, bwe->min_kbps, bwe->max_kbps);
+    bwe->min_rtt = 0;
+}
+
+guint
+bwe_on_report(BweController* bwe, gdouble fraction_lost, gdouble rtt)
+{
+    gdouble target = bwe->target_kbps;
+
+    if (rtt > 0 && (bwe->min_rtt == 0 || rtt < bwe->min_rtt))
+        bwe->min_rtt = rtt;
+
+    gboolean queueing = rtt > RTT_QUEUEING_FLOOR && rtt > bwe->min_rtt * RTT_QUEUEING_FACTOR;
+
+    if (fraction_lost > LOSS_HIGH)
+        target *= 1.0 - 0.5 * fraction_lost;
+    else if (queueing)
+        target *= 0.85;
+    else if (fraction_lost < LOSS_LOW)
+        target = target * 1.08 + 1;
+
+    bwe->target_kbps = CLAMP((guint)target, bwe->min_kbps, bwe->max_kbps);
+    return bwe->target_kbps;
+}
+
+/* Floors are roughly where x264 zerolatency stops looking worse than the
+ * next rung down at 30 fps */
+static const struct {
+    guint width;
+    guint height;
+    guint min_kbps;
+} ladder[] = {
+    { 1920, 1080, 3500 },
+    { 1280, 720, 1800 },
+    { 960, 540, 1100 },
+    { 640, 360, 600 },
+    { 480, 270, 350 },
+    { 320, 180, 0 },
+};
+
+void
+bwe_resolution_for(guint kbps, guint max_width, guint max_height,
+    guint* width, guint* height)
+{
+    for (guint i = 0; i < G_N_ELEMENTS(ladder); i++) {
+        if (ladder[i].width > max_width || ladder[i].height > max_height)
+            continue;
+        if (kbps >= ladder[i].min_kbps || i == G_N_ELEMENTS(ladder) - 1) {
+            *width = ladder[i].width;
+            *height = ladder[i].height;
+            return;
+        }
+    }
+    *width = max_width;
+    *height = max_height;
+}
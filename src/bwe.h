@@ -0,0 +1,32 @@
+/*
+ * bwe.h — loss/RTT based send-rate controller for the sender.
+ *
+ * The loss half of Google Congestion Control, fed from RTCP receiver reports
+ * (webrtcbin "get-stats", remote-inbound-rtp): more than 10% loss cuts the
+ * rate by half the loss fraction, less than 2% raises it by 8% per report,
+ * anything in between holds. An RTT well above the lowest seen counts as
+ * queueing and backs off too. Used when rtpgccbwe (TWCC based) is missing.
+ */
+#ifndef BWE_H
+#define BWE_H
+
+#include <glib.h>
+
+typedef struct {
+    guint min_kbps;
+    guint max_kbps;
+    guint target_kbps;
+    gdouble min_rtt;    /* seconds; 0 until the first report */
+} BweController;
+
+void bwe_init(BweController* bwe, guint min_kbps, guint max_kbps, guint start_kbps);
+
+/* One receiver report; returns the new target. */
+guint bwe_on_report(BweController* bwe, gdouble fraction_lost, gdouble rtt);
+
+/* Resolution for a bitrate: the largest rung of a fixed 16:9 ladder (up to
+ * max_width x max_height) whose floor the bitrate clears. */
+void bwe_resolution_for(guint kbps, guint max_width, guint max_height,
+    guint* width, guint* height);
+
+#endif /* BWE_H */
@@ -0,0 +1,173 @@
+/*
+ * capture.c — see capture.h.
+ */
+
+#include "capture.h"
+
+typedef enum {
+    FORMATS_DEVICE,     /* ask the opened device */
+    FORMATS_ANY,        /* synthesises whatever is asked for */
+    FORMATS_UNKNOWN,    /* depends on the file; always convert */
+} FormatSupport;
+
+struct _CaptureBackend {
+    const gchar* name;
+    const gchar* factory;
+    const gchar* device_prop;   /* NULL: no device selection */
+    const gchar* props;         /* fixed properties, gst-launch syntax */
+    const gchar* zero_copy;     /* extra properties for zero_copy, or NULL */
+    FormatSupport formats;
+    gboolean live;              /* considered by capture_backend_probe() */
+    gboolean device_required;   /* nothing to open without one */
+};
+
+/* Probe order: the platform cameras first, the test pattern last */
+static const CaptureBackend backends[] = {
+    { "mf", "mfvideosrc", "device-path", "do-timestamp=true", NULL,
+      FORMATS_DEVICE, TRUE, FALSE },
+    { "v4l2", "v4l2src", "device", "do-timestamp=true", "io-mode=dmabuf",
+      FORMATS_DEVICE, TRUE, FALSE },
+    { "pipewire", "pipewiresrc", "path", "do-timestamp=true", NULL,
+      FORMATS_DEVICE, TRUE, FALSE },
+    { "test", "videotestsrc", NULL, "is-live=true", NULL,
+      FORMATS_ANY, TRUE, FALSE },
+    { "file", "filesrc", "location", NULL, NULL,
+      FORMATS_UNKNOWN, FALSE, TRUE },
+};
+
+/* ---------- Lookup ---------- */
+static GstElement*
+open_device(const CaptureBackend* backend, const gchar* device)
+{
+    GstElement* element = gst_element_factory_make(backend->factory, NULL);
+    if (!element)
+        return NULL;
+
+    if (device && backend->device_prop)
+        g_object_set(element, backend->device_prop, device, NULL);
+
+    if (gst_element_set_state(element, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE) {
+        gst_element_set_state(element, GST_STATE_NULL);
+        gst_object_unref(element);
+        return NULL;
+    }
+    return element;
+}
+
+static void
+close_device(GstElement* element)
+{
+    gst_element_set_state(element, GST_STATE_NULL);
+    gst_object_unref(element);
+}
+
+const CaptureBackend*
+capture_backend_probe(const gchar* device)
+{
+    for (guint i = 0; i < G_N_ELEMENTS(backends); i++) {
+        if (!backends[i].live)
+            continue;
+
+        GstElement* element = open_device(&backends[i], device);
+        if (element) {
+            close_device(element);
+            return &backends[i];
+        }
+    }
+    return NULL;
+}
+
+const CaptureBackend*
+capture_backend_find(const gchar* name)
+{
+    for (guint i = 0; i < G_N_ELEMENTS(backends); i++) {
+        if (g_strcmp0(backends[i].name, name) == 0 || g_strcmp0(backends[i].factory, name) == 0)
+            return &backends[i];
+    }
+    return NULL;
+}
+
+const gchar*
+capture_backend_name(const CaptureBackend* backend)
+{
+    return backend->name;
+}
+
+gboolean
+capture_backend_needs_device(const CaptureBackend* backend)
+{
+    return backend->device_required;
+}
+
+gchar*
+capture_backend_list_names(void)
+{
+    GString* names = g_string_new(NULL);
+    for (guint i = 0; i < G_N_ELEMENTS(backends); i++) {
+        if (i > 0)
+            g_string_append(names, ", ");
+        g_string_append(names, backends[i].name);
+    }
+    return g_string_free(names, FALSE);
+}
+
+/* ---------- Pipeline ---------- */
+gchar*
+capture_backend_describe(const CaptureBackend* backend, const gchar* element_name,
+    const gchar* device, gboolean zero_copy)
+{
+    /* Files are decoded, scaled and paced to real time before they count as a camera */
+    if (backend->formats == FORMATS_UNKNOWN) {
+        return g_strdup_printf("%s %s=\"%s\" ! decodebin ! videoscale ! videorate ! "
+            "identity name=%s sync=true",
+            backend->factory, backend->device_prop, device ? device : "", element_name);
+    }
+
+    GString* desc = g_string_new(NULL);
+    g_string_append_printf(desc, "%s name=%s", backend->factory, element_name);
+    if (device && backend->device_prop)
+        g_string_append_printf(desc, " %s=\"%s\"", backend->device_prop, device);
+    if (backend->props)
+        g_string_append_printf(desc, " %s", backend->props);
+    if (zero_copy && backend->zero_copy)
+        g_string_append_printf(desc, " %s", backend->zero_copy);
+    return g_string_free(desc, FALSE);
+}
+
+gboolean
+capture_backend_supports(const CaptureBackend* backend, const gchar* device,
+    const gchar* format, guint width, guint height, guint fps)
+{
+    if (backend->formats == FORMATS_ANY)
+        return TRUE;
+    if (backend->formats == FORMATS_UNKNOWN)
+        return FALSE;
+
+    GstElement* element = open_device(backend, device);
+    if (!element)
+        return FALSE;
+
+    GstPad* src = gst_element_get_static_pad(element, "src");
+    GstCaps* device_caps = src ? gst_pad_query_caps(src, NULL) : NULL;
+    GstCaps* template_caps = src ? gst_pad_get_pad_template_caps(src) : NULL;
+    GstCaps* wanted = gst_caps_new_simple("video/x-raw",
+        "format", G_TYPE_STRING, format,
+        "width", G_TYPE_INT, (gint)width,
+        "height", G_TYPE_INT, (gint)height,
+        "framerate", GST_TYPE_FRACTION, (gint)fps, 1,
+        NULL);
+
+    /* Template caps mean the source did not look at the device in READY */
+    gboolean ok = device_caps && !gst_caps_is_equal(device_caps, template_caps) &&
+        gst_caps_can_intersect(device_caps, wanted);
+
+    gst_caps_unref(wanted);
+    if (template_caps)
+        gst_caps_unref(template_caps);
+    if (device_caps)
+        gst_caps_unref(device_caps);
+    if (src)
+        gst_object_unref(src);
+    close_device(element);
+    return ok;
+}
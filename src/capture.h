@@ -0,0 +1,42 @@
+/*
+ * capture.h — video capture backends for the sender.
+ *
+ * Each backend turns a device (or file) into a gst-launch fragment whose last
+ * element is named as asked, so probes can find it. capture_backend_probe()
+ * returns the first backend, in table order, whose element reaches READY with
+ * the given device. capture_backend_supports() asks the opened device whether
+ * it can deliver a raw format itself, so the sender can skip videoconvert.
+ */
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+typedef struct _CaptureBackend CaptureBackend;
+
+/* First usable live source for device (NULL = backend default). */
+const CaptureBackend* capture_backend_probe(const gchar* device);
+
+/* By CLI name ("mf", "v4l2", "pipewire", "test", "file"). Does not probe. */
+const CaptureBackend* capture_backend_find(const gchar* name);
+
+const gchar* capture_backend_name(const CaptureBackend* backend);
+
+/* TRUE when the backend has nothing to open without a device (file). */
+gboolean capture_backend_needs_device(const CaptureBackend* backend);
+
+/* gst-launch fragment ending in an element called element_name. zero_copy asks
+ * for dmabuf buffers where the backend has them (v4l2 io-mode=dmabuf). */
+gchar* capture_backend_describe(const CaptureBackend* backend, const gchar* element_name,
+    const gchar* device, gboolean zero_copy);
+
+/* TRUE when the device itself offers format at width x height @ fps.
+ * FALSE also means "cannot tell", e.g. for files. */
+gboolean capture_backend_supports(const CaptureBackend* backend, const gchar* device,
+    const gchar* format, guint width, guint height, guint fps);
+
+/* Comma-separated CLI names, for --help and error messages. */
+gchar* capture_backend_list_names(void);
+
+#endif /* CAPTURE_H */
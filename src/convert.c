@@ -0,0 +1,83 @@
+/*
+ * convert.c — see convert.h.
+ */
+
+#include "convert.h"
+
+#include <gst/base/gstbasetransform.h>
+
+/* Past four threads the memory bus, not the cores, limits a 360p-1080p pass */
+#define CONVERT_MAX_THREADS 4
+
+guint
+convert_threads(guint n_converters)
+{
+    guint cores = (guint)g_get_num_processors();
+    return CLAMP(cores / MAX(n_converters, 1), 1, CONVERT_MAX_THREADS);
+}
+
+static const gchar*
+pad_format(GstElement* element, const gchar* pad_name, GstCaps** caps)
+{
+    GstPad* pad = gst_element_get_static_pad(element, pad_name);
+    *caps = pad ? gst_pad_get_current_caps(pad) : NULL;
+    if (pad)
+        gst_object_unref(pad);
+
+    const gchar* format = *caps ? gst_structure_get_string(gst_caps_get_structure(*caps, 0), "format") : NULL;
+    return format ? format : "?";
+}
+
+gchar*
+convert_describe(GstElement* converter)
+{
+    GstCaps* in_caps = NULL;
+    GstCaps* out_caps = NULL;
+    const gchar* in = pad_format(converter, "sink", &in_caps);
+    const gchar* out = pad_format(converter, "src", &out_caps);
+    gchar* text;
+
+    if (gst_base_transform_is_passthrough(GST_BASE_TRANSFORM(converter))) {
+        text = g_strdup_printf("passthrough (%s)", in);
+    }
+    else {
+        guint threads = 1;
+        if (g_object_class_find_property(G_OBJECT_GET_CLASS(converter), "n-threads"))
+            g_object_get(converter, "n-threads", &threads, NULL);
+        text = g_strdup_printf("%s -> %s, %u thread%s", in, out, threads, threads == 1 ? "" : "s");
+    }
+
+    if (in_caps)
+        gst_caps_unref(in_caps);
+    if (out_caps)
+        gst_caps_unref(out_caps);
+    return text;
+}
+
+/* Streaming thread: caps are fixed by the first buffer, so the path is known */
+static GstPadProbeReturn
+on_converter_output(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    (void)info;
+    const gchar* prefix = user_data;
+
+    GstElement* converter = gst_pad_get_parent_element(pad);
+    if (converter) {
+        gchar* path = convert_describe(converter);
+        g_print("%s %s: %s\n", prefix, GST_OBJECT_NAME(converter), path);
+        g_free(path);
+        gst_object_unref(converter);
+    }
+    return GST_PAD_PROBE_REMOVE;
+}
+
+void
+convert_report_first_buffer(GstElement* converter, const gchar* prefix)
+{
+    GstPad* src = gst_element_get_static_pad(converter, "src");
+    if (!src)
+        return;
+    gst_pad_add_probe(src, GST_PAD_PROBE_TYPE_BUFFER, on_converter_output,
+        g_strdup(prefix), g_free);
+    gst_object_unref(src);
+}
@@ -0,0 +1,28 @@
+/*
+ * convert.h — helpers for the videoconvert/videoscale stages.
+ *
+ * The conversion elements stay in the pipelines, but a basetransform whose
+ * input and output caps agree runs in passthrough and never touches the
+ * frame. When caps do differ the full-frame pass is spread over
+ * convert_threads() threads, the cores being shared by all converters.
+ * convert_describe() tells which of the two happened once caps are
+ * negotiated.
+ */
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+/* n-threads for each of n_converters converters running side by side: the
+ * cores shared between them, at least 1 and at most 4 each */
+guint convert_threads(guint n_converters);
+
+/* "passthrough (I420)" or "NV12 -> I420, 4 threads"; g_free() the result. */
+gchar* convert_describe(GstElement* converter);
+
+/* Prints "<prefix> <name>: <convert_describe()>" once the converter's first
+ * buffer is out, when its caps and so its path are fixed. */
+void convert_report_first_buffer(GstElement* converter, const gchar* prefix);
+
+#endif /* CONVERT_H */
@@ -0,0 +1,151 @@
+/*
+ * encoder.c — see encoder.h.
+ */
+
+#include "encoder.h"
+
+typedef enum {
+    BITRATE_KBPS,
+    BITRATE_BPS,
+    BITRATE_V4L2_CONTROLS,  /* no properties; bitrate/GOP go through extra-controls */
+} BitrateUnit;
+
+struct _EncoderBackend {
+    const gchar* name;
+    const gchar* factory;
+    const gchar* input_format;
+    BitrateUnit bitrate_unit;
+    const gchar* bitrate_prop;
+    const gchar* gop_prop;
+    const gchar* zero_latency;  /* fixed properties, gst-launch syntax */
+};
+
+/* Cheapest per core first. Hardware encoders only count once they reach
+ * READY; x264 is the software fallback that is always tried last. */
+static const EncoderBackend backends[] = {
+    { "nvenc", "nvh264enc", "NV12", BITRATE_KBPS, "bitrate", "gop-size",
+      "rc-mode=cbr zerolatency=true bframes=0" },
+    { "qsv", "qsvh264enc", "NV12", BITRATE_KBPS, "bitrate", "gop-size",
+      "rate-control=cbr b-frames=0" },
+    { "mf", "mfh264enc", "NV12", BITRATE_KBPS, "bitrate", "gop-size",
+      "rc-mode=cbr low-latency=true bframes=0" },
+    { "va", "vah264enc", "NV12", BITRATE_KBPS, "bitrate", "key-int-max",
+      "rate-control=cbr b-frames=0" },
+    { "vaapi", "vaapih264enc", "NV12", BITRATE_KBPS, "bitrate", "keyframe-period",
+      "rate-control=cbr max-bframes=0" },
+    { "v4l2", "v4l2h264enc", "NV12", BITRATE_V4L2_CONTROLS, NULL, NULL,
+      NULL },
+    { "openh264", "openh264enc", "I420", BITRATE_BPS, "bitrate", "gop-size",
+      "usage-type=camera rate-control=bitrate complexity=low" },
+    { "x264", "x264enc", "I420", BITRATE_KBPS, "bitrate", "key-int-max",
+      "tune=zerolatency speed-preset=ultrafast bframes=0 byte-stream=true aud=false" },
+};
+
+/* ---------- Lookup ---------- */
+static gboolean
+backend_is_usable(const EncoderBackend* backend)
+{
+    GstElementFactory* factory = gst_element_factory_find(backend->factory);
+    if (!factory)
+        return FALSE;
+
+    /* Hardware plugins register even without a device; READY opens it */
+    GstElement* element = gst_element_factory_create(factory, NULL);
+    gst_object_unref(factory);
+    if (!element)
+        return FALSE;
+
+    gboolean ok = gst_element_set_state(element, GST_STATE_READY) != GST_STATE_CHANGE_FAILURE;
+    gst_element_set_state(element, GST_STATE_NULL);
+    gst_object_unref(element);
+    return ok;
+}
+
+const EncoderBackend*
+encoder_backend_probe(void)
+{
+    for (guint i = 0; i < G_N_ELEMENTS(backends); i++) {
+        if (backend_is_usable(&backends[i]))
+            return &backends[i];
+    }
+    return NULL;
+}
+
+const EncoderBackend*
+encoder_backend_find(const gchar* name)
+{
+    for (guint i = 0; i < G_N_ELEMENTS(backends); i++) {
+        if (g_strcmp0(backends[i].name, name) == 0 || g_strcmp0(backends[i].factory, name) == 0)
+            return &backends[i];
+    }
+    return NULL;
+}
+
+const gchar*
+encoder_backend_name(const EncoderBackend* backend)
+{
+    return backend->name;
+}
+
+const gchar*
+encoder_backend_factory(const EncoderBackend* backend)
+{
+    return backend->factory;
+}
+
+const gchar*
+encoder_backend_input_format(const EncoderBackend* backend)
+{
+    return backend->input_format;
+}
+
+gchar*
+encoder_backend_list_names(void)
+{
+    GString* names = g_string_new(NULL);
+    for (guint i = 0; i < G_N_ELEMENTS(backends); i++) {
+        if (i > 0)
+            g_string_append(names, ", ");
+        g_string_append(names, backends[i].name);
+    }
+    return g_string_free(names, FALSE);
+}
+
+/* ---------- Properties ---------- */
+static guint
+bitrate_value(const EncoderBackend* backend, guint bitrate_kbps)
+{
+    return backend->bitrate_unit == BITRATE_BPS ? bitrate_kbps * 1000 : bitrate_kbps;
+}
+
+gchar*
+encoder_backend_describe(const EncoderBackend* backend, const gchar* element_name,
+    guint bitrate_kbps, guint gop)
+{
+    if (backend->bitrate_unit == BITRATE_V4L2_CONTROLS) {
+        return g_strdup_printf("%s name=%s "
+            "extra-controls=\"controls,video_bitrate=%u,h264_i_frame_period=%u,video_b_frames=0\"",
+            backend->factory, element_name, bitrate_kbps * 1000, gop);
+    }
+
+    return g_strdup_printf("%s name=%s %s=%u %s=%u %s",
+        backend->factory, element_name,
+        backend->bitrate_prop, bitrate_value(backend, bitrate_kbps),
+        backend->gop_prop, gop,
+        backend->zero_latency);
+}
+
+void
+encoder_backend_set_bitrate(const EncoderBackend* backend, GstElement* encoder,
+    guint bitrate_kbps)
+{
+    if (backend->bitrate_unit == BITRATE_V4L2_CONTROLS) {
+        GstStructure* controls = gst_structure_new("controls",
+            "video_bitrate", G_TYPE_INT, (gint)(bitrate_kbps * 1000), NULL);
+        g_object_set(encoder, "extra-controls", controls, NULL);
+        gst_structure_free(controls);
+        return;
+    }
+
+    g_object_set(encoder, backend->bitrate_prop, bitrate_value(backend, bitrate_kbps), NULL);
+}
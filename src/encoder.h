@@ -0,0 +1,41 @@
+/*
+ * encoder.h — H.264 encoder backends for the sender.
+ *
+ * Every backend maps the same three knobs (bitrate in kbit/s, GOP length in
+ * frames, zero-latency: no B-frames, no lookahead, CBR-ish rate control) onto
+ * its element's own properties. encoder_backend_probe() walks the table from
+ * cheapest per core (hardware first) to most expensive and returns the first
+ * one whose element exists and reaches READY, i.e. whose device is present.
+ */
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+typedef struct _EncoderBackend EncoderBackend;
+
+/* Cheapest usable backend, or NULL when no H.264 encoder is installed. */
+const EncoderBackend* encoder_backend_probe(void);
+
+/* By CLI name ("x264", "openh264", "va", ...). Does not probe the device. */
+const EncoderBackend* encoder_backend_find(const gchar* name);
+
+const gchar* encoder_backend_name(const EncoderBackend* backend);
+const gchar* encoder_backend_factory(const EncoderBackend* backend);
+
+/* Raw format the encoder takes without an internal conversion (I420, NV12). */
+const gchar* encoder_backend_input_format(const EncoderBackend* backend);
+
+/* gst-launch fragment "<factory> name=<element_name> <props>" */
+gchar* encoder_backend_describe(const EncoderBackend* backend, const gchar* element_name,
+    guint bitrate_kbps, guint gop);
+
+/* Changes the bitrate of a running encoder made from describe(). */
+void encoder_backend_set_bitrate(const EncoderBackend* backend, GstElement* encoder,
+    guint bitrate_kbps);
+
+/* Comma-separated CLI names, for --help and error messages. */
+gchar* encoder_backend_list_names(void);
+
+#endif /* ENCODER_H */
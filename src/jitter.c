@@ -0,0 +1,78 @@
+/*
+ * jitter.c — see jitter.h.
+ */
+
+#include "jitter.h"
+
+#define JITTER_HEADROOM   4.0
+#define JITTER_FLOOR_MS   10.0
+#define LOSS_THRESHOLD    0.01
+#define DECAY             0.9
+#define QUEUE_HEADROOM    1.5
+
+void
+jitter_tuner_init(JitterTuner* tuner, guint min_ms, guint max_ms,
+    guint min_buffers, guint max_buffers)
+{
+    tuner->min_ms = min_ms;
+    tuner->max_ms = MAX(max_ms, min_ms);
+    tuner->min_buffers = MAX(min_buffers, 1);
+    tuner->max_buffers = MAX(max_buffers, tuner->min_buffers);
+
+    /* A quarter of the way up: safe to start with, quick to come down from */
+    tuner->latency_ms = tuner->min_ms + (tuner->max_ms - tuner->min_ms) / 4;
+    tuner->queue_buffers = tuner->min_buffers;
+    tuner->jitter_ms = 0;
+    tuner->packets_received = 0;
+    tuner->packets_lost = 0;
+    tuner->at_us = 0;
+}
+
+gboolean
+jitter_tuner_on_report(JitterTuner* tuner, gdouble jitter,
+    guint64 packets_received, gint64 packets_lost, gint64 now_us)
+{
+    gdouble jitter_ms = jitter * 1000.0;
+    gdouble loss = 0;
+    gdouble packet_rate = 0;
+
+    if (tuner->at_us && now_us > tuner->at_us && packets_received >= tuner->packets_received) {
+        gdouble received = (gdouble)(packets_received - tuner->packets_received);
+        gdouble lost = (gdouble)MAX(packets_lost - tuner->packets_lost, 0);
+        if (received + lost > 0)
+            loss = lost / (received + lost);
+        packet_rate = received * G_USEC_PER_SEC / (gdouble)(now_us - tuner->at_us);
+    }
+    tuner->packets_received = packets_received;
+    tuner->packets_lost = packets_lost;
+    tuner->at_us = now_us;
+
+    /* Spikes count at once, calm only slowly */
+    if (jitter_ms > tuner->jitter_ms)
+        tuner->jitter_ms = jitter_ms;
+    else
+        tuner->jitter_ms = 0.75 * tuner->jitter_ms + 0.25 * jitter_ms;
+
+    gdouble want = JITTER_HEADROOM * tuner->jitter_ms + JITTER_FLOOR_MS;
+    if (loss > LOSS_THRESHOLD)
+        want *= 1.5;
+    if (want < tuner->latency_ms * DECAY)
+        want = tuner->latency_ms * DECAY;
+    guint latency_ms = CLAMP((guint)want, tuner->min_ms, tuner->max_ms);
+
+    /* No rate yet: keep the depth until there is one */
+    guint queue_buffers = tuner->queue_buffers;
+    if (packet_rate > 0) {
+        gdouble depth = packet_rate * latency_ms / 1000.0 * QUEUE_HEADROOM;
+        queue_buffers = CLAMP((guint)depth, tuner->min_buffers, tuner->max_buffers);
+    }
+
+    /* Small steps are not worth a latency renegotiation */
+    gboolean changed = ABS((gint)latency_ms - (gint)tuner->latency_ms) * 20 > (gint)tuner->latency_ms ||
+        queue_buffers != tuner->queue_buffers;
+    if (changed) {
+        tuner->latency_ms = latency_ms;
+        tuner->queue_buffers = queue_buffers;
+    }
+    return changed;
+}
@@ -0,0 +1,37 @@
+/*
+ * jitter.h — receive-side latency controller for the receiver.
+ *
+ * Fed from webrtcbin "get-stats" (inbound-rtp jitter, packets received and
+ * lost), it picks a jitterbuffer latency and a depth for the queue in front
+ * of the depayloader. Latency follows four times the smoothed interarrival
+ * jitter plus a floor, with half again on top while packets are being lost;
+ * it rises at once and decays by at most 10% per report. The queue holds that
+ * much time at the measured packet rate.
+ */
+#ifndef JITTER_H
+#define JITTER_H
+
+#include <glib.h>
+
+typedef struct {
+    guint min_ms;
+    guint max_ms;
+    guint min_buffers;
+    guint max_buffers;
+    guint latency_ms;       /* current choice */
+    guint queue_buffers;    /* current choice */
+    gdouble jitter_ms;      /* smoothed; 0 until the first report */
+    guint64 packets_received;
+    gint64 packets_lost;
+    gint64 at_us;           /* time of the previous report, 0 before it */
+} JitterTuner;
+
+void jitter_tuner_init(JitterTuner* tuner, guint min_ms, guint max_ms,
+    guint min_buffers, guint max_buffers);
+
+/* One inbound-rtp report (jitter in seconds, cumulative counters).
+ * Returns TRUE when latency_ms or queue_buffers changed enough to apply. */
+gboolean jitter_tuner_on_report(JitterTuner* tuner, gdouble jitter,
+    guint64 packets_received, gint64 packets_lost, gint64 now_us);
+
+#endif /* JITTER_H */
@@ -0,0 +1,198 @@
+/*
+ * latency_stamp.c — see latency_stamp.h.
+ */
+
+#include "latency_stamp.h"
+
+#include <gst/rtp/rtp.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MAP_SIZE 64
+
+/* ---------- Header extension ---------- */
+gboolean
+latency_stamp_write(GstBuffer** buffer, gint64 capture_us)
+{
+    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+    guint8 data[8];
+
+    for (guint i = 0; i < sizeof(data); i++)
+        data[i] = (guint8)((guint64)capture_us >> (56 - 8 * i));
+
+    *buffer = gst_buffer_make_writable(*buffer);
+    if (!gst_rtp_buffer_map(*buffer, GST_MAP_READWRITE, &rtp))
+        return FALSE;
+
+    gboolean ok = gst_rtp_buffer_add_extension_onebyte_header(&rtp,
+        LATENCY_STAMP_EXT_ID, data, sizeof(data));
+    gst_rtp_buffer_unmap(&rtp);
+    return ok;
+}
+
+gboolean
+latency_stamp_read(GstBuffer* buffer, gint64* capture_us)
+{
+    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+    gpointer data = NULL;
+    guint size = 0;
+
+    if (!gst_rtp_buffer_map(buffer, GST_MAP_READ, &rtp))
+        return FALSE;
+
+    gboolean ok = gst_rtp_buffer_get_extension_onebyte_header(&rtp,
+        LATENCY_STAMP_EXT_ID, 0, &data, &size) && size == 8;
+    if (ok) {
+        guint64 v = 0;
+        for (guint i = 0; i < 8; i++)
+            v = (v << 8) | ((const guint8*)data)[i];
+        *capture_us = (gint64)v;
+    }
+
+    gst_rtp_buffer_unmap(&rtp);
+    return ok;
+}
+
+/* ---------- PTS -> capture time ---------- */
+typedef struct {
+    GstClockTime pts;
+    gint64 capture_us;
+} MapEntry;
+
+struct _LatencyStampMap {
+    GMutex lock;
+    MapEntry entries[MAP_SIZE];
+    guint next;
+};
+
+LatencyStampMap*
+latency_stamp_map_new(void)
+{
+    LatencyStampMap* map = g_new0(LatencyStampMap, 1);
+    g_mutex_init(&map->lock);
+    for (guint i = 0; i < MAP_SIZE; i++)
+        map->entries[i].pts = GST_CLOCK_TIME_NONE;
+    return map;
+}
+
+void
+latency_stamp_map_free(LatencyStampMap* map)
+{
+    if (!map)
+        return;
+    g_mutex_clear(&map->lock);
+    g_free(map);
+}
+
+void
+latency_stamp_map_put(LatencyStampMap* map, GstClockTime pts, gint64 capture_us)
+{
+    if (!GST_CLOCK_TIME_IS_VALID(pts))
+        return;
+
+    g_mutex_lock(&map->lock);
+    /* Every packet of a frame carries the same PTS; keep one entry per frame */
+    guint last = (map->next + MAP_SIZE - 1) % MAP_SIZE;
+    if (map->entries[last].pts != pts) {
+        map->entries[map->next].pts = pts;
+        map->entries[map->next].capture_us = capture_us;
+        map->next = (map->next + 1) % MAP_SIZE;
+    }
+    g_mutex_unlock(&map->lock);
+}
+
+gboolean
+latency_stamp_map_lookup(LatencyStampMap* map, GstClockTime pts, gint64* capture_us)
+{
+    gboolean found = FALSE;
+
+    if (!GST_CLOCK_TIME_IS_VALID(pts))
+        return FALSE;
+
+    g_mutex_lock(&map->lock);
+    for (guint i = 0; i < MAP_SIZE; i++) {
+        if (map->entries[i].pts == pts) {
+            *capture_us = map->entries[i].capture_us;
+            found = TRUE;
+            break;
+        }
+    }
+    g_mutex_unlock(&map->lock);
+    return found;
+}
+
+/* ---------- Percentiles ---------- */
+struct _LatencyStats {
+    gint64 samples[LATENCY_STATS_WINDOW];  /* ring of µs, oldest overwritten */
+    gint64 sorted[LATENCY_STATS_WINDOW];   /* scratch for percentiles */
+    guint count;                            /* every sample ever added */
+};
+
+LatencyStats*
+latency_stats_new(void)
+{
+    return g_new0(LatencyStats, 1);
+}
+
+void
+latency_stats_free(LatencyStats* stats)
+{
+    g_free(stats);
+}
+
+void
+latency_stats_add(LatencyStats* stats, gint64 latency_us)
+{
+    stats->samples[stats->count % LATENCY_STATS_WINDOW] = latency_us;
+    stats->count++;
+}
+
+guint
+latency_stats_count(const LatencyStats* stats)
+{
+    return stats->count;
+}
+
+static gint
+compare_int64(gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64*)a, y = *(const gint64*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Nearest-rank percentile over n sorted samples */
+static gdouble
+percentile_ms(const gint64* sorted, guint n, guint pct)
+{
+    guint rank = (n * pct + 99) / 100;
+    if (rank == 0)
+        rank = 1;
+    return sorted[rank - 1] / 1000.0;
+}
+
+const gchar*
+latency_stats_write_json(LatencyStats* stats, GString* out)
+{
+    guint n = MIN(stats->count, LATENCY_STATS_WINDOW);
+
+    if (n == 0) {
+        g_string_assign(out, "{\"frames\":0}");
+        return out->str;
+    }
+
+    /* Order does not matter once sorted, so the ring is copied as is */
+    memcpy(stats->sorted, stats->samples, n * sizeof(gint64));
+    qsort(stats->sorted, n, sizeof(gint64), compare_int64);
+
+    g_string_printf(out,
+        "{\"frames\":%u,\"window\":%u,\"min_ms\":%.1f,\"p50_ms\":%.1f,\"p95_ms\":%.1f,"
+        "\"p99_ms\":%.1f,\"max_ms\":%.1f}",
+        stats->count, n,
+        stats->sorted[0] / 1000.0,
+        percentile_ms(stats->sorted, n, 50),
+        percentile_ms(stats->sorted, n, 95),
+        percentile_ms(stats->sorted, n, 99),
+        stats->sorted[n - 1] / 1000.0);
+    return out->str;
+}
@@ -0,0 +1,52 @@
+/*
+ * latency_stamp.h — capture-time stamps for glass-to-glass latency runs.
+ *
+ * The sender notes the wall-clock time each frame leaves the camera and, after
+ * payloading, writes it into every RTP packet of that frame as a one-byte
+ * header extension (id LATENCY_STAMP_EXT_ID, 8 bytes, big-endian µs since the
+ * epoch). The receiver reads it back before depayloading and matches it to
+ * the decoded frame by PTS. Both ends use g_get_real_time(): exact on a
+ * loopback run, as good as NTP across hosts.
+ */
+#ifndef LATENCY_STAMP_H
+#define LATENCY_STAMP_H
+
+#include <glib.h>
+#include <gst/gst.h>
+
+/* Outside the ids webrtcbin hands out for negotiated extensions */
+#define LATENCY_STAMP_EXT_ID 14
+
+/* Adds the stamp to an RTP buffer; *buffer is made writable if needed. */
+gboolean latency_stamp_write(GstBuffer** buffer, gint64 capture_us);
+gboolean latency_stamp_read(GstBuffer* buffer, gint64* capture_us);
+
+/* PTS -> capture time for the frames in flight between two probes. Every
+ * packet of a frame shares its PTS, so lookups leave the entry in place; it
+ * is overwritten once the ring wraps. Thread-safe. */
+typedef struct _LatencyStampMap LatencyStampMap;
+
+LatencyStampMap* latency_stamp_map_new(void);
+void latency_stamp_map_free(LatencyStampMap* map);
+void latency_stamp_map_put(LatencyStampMap* map, GstClockTime pts, gint64 capture_us);
+gboolean latency_stamp_map_lookup(LatencyStampMap* map, GstClockTime pts, gint64* capture_us);
+
+/* Glass-to-glass samples; not thread-safe, keep to one streaming thread.
+ * Only the last LATENCY_STATS_WINDOW samples are kept (a minute at 30 fps),
+ * so memory and the cost of a report stay fixed on a long session. */
+#define LATENCY_STATS_WINDOW 1800
+
+typedef struct _LatencyStats LatencyStats;
+
+LatencyStats* latency_stats_new(void);
+void latency_stats_free(LatencyStats* stats);
+void latency_stats_add(LatencyStats* stats, gint64 latency_us);
+/* Every sample added so far, including those out of the window */
+guint latency_stats_count(const LatencyStats* stats);
+
+/* Overwrite out with
+ * {"frames":N,"window":W,"min_ms":..,"p50_ms":..,"p95_ms":..,"p99_ms":..,"max_ms":..}
+ * where frames counts every sample and the rest cover the last W. */
+const gchar* latency_stats_write_json(LatencyStats* stats, GString* out);
+
+#endif /* LATENCY_STAMP_H */
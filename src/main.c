@@ -19,6 +19,9 @@
 
 #include <string.h>
 
+/* Candidates per {"ice":[...]} message; receivers keep no more than this */
+#define ICE_BATCH_MAX 32
+
 enum AppState
 {
     APP_STATE_UNKNOWN = 0,
@@ -44,8 +47,29 @@ enum AppState
 GST_DEBUG_CATEGORY_STATIC(GST_CAT_DEFAULT);
 
 static GMainLoop* loop;
-static GstElement* pipe1, * webrtc1 = NULL;
-static GObject* send_channel, * receive_channel;
+
+/*
+ * One call: a pipeline with its own webrtcbin, talking to one peer. Without
+ * --multiplex there is a single call and signaling frames are its messages
+ * as they are. With --multiplex one registration carries a call per peer:
+ * frames go out as "TO <peer> <message>" and come in as
+ * "FROM <peer> <message>", and the peer id picks the call.
+ */
+typedef struct {
+    gchar* peer_id;
+    enum AppState state;
+    GstElement* pipe;
+    GstElement* webrtc;
+    GObject* send_channel;
+    GObject* receive_channel;
+    gboolean create_offer;          /* we offer, rather than answer */
+
+    /* Local candidates waiting to go out as one {"ice":[...]} message.
+     * on-ice-candidate fires on webrtcbin threads, hence the lock. */
+    GMutex ice_batch_lock;
+    JsonArray* ice_batch;
+    guint ice_batch_source;
+} Call;
 
 static SoupWebsocketConnection* ws_conn = NULL;
 static enum AppState app_state = 0;
@@ -55,12 +79,20 @@ static gchar* our_id = NULL;
 static const gchar* server_url = "wss://webrtc.nirbheek.in:8443";
 static gboolean disable_ssl = FALSE;
 static gboolean remote_is_offerer = FALSE;
+static gint ice_batch_ms = 0;
+static gboolean multiplex = FALSE;
+static gboolean compress_signaling = FALSE;
+static gint max_calls = 16;
+
+static Call* single_call = NULL;    /* without --multiplex */
+static GHashTable* calls = NULL;    /* peer id -> Call*, with --multiplex */
 // GOptionEntry - масив команд (суфіксів) до нашого скрипта
 // --peer-id=стркока 
 // перше це назва суфікса, друге коротке ім'я суфікса, флаги(хз), тип аргумента, вказівник на змінну куди записувати, опис для допомоги, опис типу аргумента для допомоги  
 static GOptionEntry entries[] = {
   {"peer-id", 0, 0, G_OPTION_ARG_STRING, &peer_id,
-      "String ID of the peer to connect to", "ID"},
+      "String ID of the peer to connect to (comma-separated with --multiplex; "
+      "with --our-id --multiplex, the peers allowed to call us, * for anyone)", "ID"},
   {"our-id", 0, 0, G_OPTION_ARG_STRING, &our_id,
       "String ID of the session that peer can connect to us", "ID"},
   {"server", 0, 0, G_OPTION_ARG_STRING, &server_url,
@@ -68,6 +100,14 @@ static GOptionEntry entries[] = {
   {"disable-ssl", 0, 0, G_OPTION_ARG_NONE, &disable_ssl, "Disable ssl", NULL},
   {"remote-offerer", 0, 0, G_OPTION_ARG_NONE, &remote_is_offerer,
       "Request that the peer generate the offer and we'll answer", NULL},
+  {"ice-batch-ms", 0, 0, G_OPTION_ARG_INT, &ice_batch_ms,
+      "Coalesce local ICE candidates gathered within MS into one message (0 = off)", "MS"},
+  {"multiplex", 0, 0, G_OPTION_ARG_NONE, &multiplex,
+      "Carry one call per peer over this single signalling connection", NULL},
+  {"compress-signaling", 0, 0, G_OPTION_ARG_NONE, &compress_signaling,
+      "Offer permessage-deflate on the signalling connection", NULL},
+  {"max-calls", 0, 0, G_OPTION_ARG_INT, &max_calls,
+      "With --our-id --multiplex, how many incoming calls to carry at once", "N"},
   {NULL},
 };
 //при будь-якій помилці запускається ця функція, яка робить хороше закриття
@@ -207,42 +247,230 @@ on_incoming_stream(GstElement* webrtc, GstPad* pad, GstElement* pipe)
     gst_object_unref(sinkpad);
 }
 
+/* ---------- Calls ---------- */
+static Call*
+call_new(const gchar* id)
+{
+    Call* call = g_new0(Call, 1);
+    call->peer_id = g_strdup(id);
+    g_mutex_init(&call->ice_batch_lock);
+    return call;
+}
+
+static void
+call_free(gpointer data)
+{
+    Call* call = data;
+
+    if (call->pipe) {
+        gst_element_set_state(GST_ELEMENT(call->pipe), GST_STATE_NULL);
+        gst_print("Pipeline stopped%s%s\n", multiplex ? " for " : "",
+            multiplex ? call->peer_id : "");
+        gst_object_unref(call->pipe);
+    }
+
+    /* Streaming has stopped, so nobody else touches the batch now */
+    if (call->ice_batch_source)
+        g_source_remove(call->ice_batch_source);
+    g_clear_pointer(&call->ice_batch, json_array_unref);
+    g_mutex_clear(&call->ice_batch_lock);
+
+    g_free(call->peer_id);
+    g_free(call);
+}
+
+/* Every message for the peer goes through here; with --multiplex it is
+ * addressed to the call's peer */
+static void
+send_to_peer(Call* call, const gchar* text)
+{
+    gchar* frame;
+
+    if (!multiplex) {
+        soup_websocket_connection_send_text(ws_conn, text);
+        return;
+    }
+
+    frame = g_strdup_printf("TO %s %s", call->peer_id, text);
+    soup_websocket_connection_send_text(ws_conn, frame);
+    g_free(frame);
+}
+
+static gboolean
+end_call_by_id(gpointer user_data)
+{
+    if (calls)
+        g_hash_table_remove(calls, user_data);
+    return G_SOURCE_REMOVE;
+}
+
+/* Without --multiplex a failed call ends the program, as before. With it
+ * only that call goes, from the main loop since we may be on a webrtcbin
+ * thread or inside one of the call's own callbacks. */
+static void
+end_call(Call* call, const gchar* msg, enum AppState state)
+{
+    if (!multiplex) {
+        cleanup_and_quit_loop(msg, state);
+        return;
+    }
+
+    if (msg)
+        gst_printerr("%s: %s\n", call->peer_id, msg);
+    if (state > 0)
+        call->state = state;
+    g_idle_add_full(G_PRIORITY_DEFAULT, end_call_by_id, g_strdup(call->peer_id), g_free);
+}
+
+/* Sends batch as {"ice":[...]} messages of at most ICE_BATCH_MAX candidates,
+ * the most a receiver accepts in one, and drops the reference */
+static void
+send_ice_batch(Call* call, JsonArray* batch)
+{
+    guint n = json_array_get_length(batch);
+    guint i, j;
+
+    for (i = 0; i < n && call->state >= PEER_CALL_NEGOTIATING && ws_conn; i += ICE_BATCH_MAX) {
+        guint count = MIN(n - i, ICE_BATCH_MAX);
+        JsonObject* msg = json_object_new();
+        gchar* text;
+
+        /* A single candidate keeps the plain object form */
+        if (count == 1) {
+            json_object_set_object_member(msg, "ice",
+                json_object_ref(json_array_get_object_element(batch, i)));
+        }
+        else {
+            JsonArray* chunk = json_array_sized_new(count);
+            for (j = 0; j < count; j++)
+                json_array_add_object_element(chunk,
+                    json_object_ref(json_array_get_object_element(batch, i + j)));
+            json_object_set_array_member(msg, "ice", chunk);
+        }
+        text = get_string_from_json_object(msg);
+        json_object_unref(msg);
+
+        send_to_peer(call, text);
+        g_free(text);
+    }
+
+    json_array_unref(batch);
+}
+
+static gboolean
+flush_ice_batch(gpointer user_data)
+{
+    Call* call = user_data;
+    JsonArray* batch;
+
+    g_mutex_lock(&call->ice_batch_lock);
+    batch = call->ice_batch;
+    call->ice_batch = NULL;
+    call->ice_batch_source = 0;
+    g_mutex_unlock(&call->ice_batch_lock);
+
+    if (batch)
+        send_ice_batch(call, batch);
+    return G_SOURCE_REMOVE;
+}
+
+/* Candidates still waiting for the batch window must not arrive behind a
+ * new description, where the peer would apply them to the wrong one */
+static void
+flush_ice_batch_now(Call* call)
+{
+    JsonArray* batch;
+
+    g_mutex_lock(&call->ice_batch_lock);
+    batch = call->ice_batch;
+    call->ice_batch = NULL;
+    if (call->ice_batch_source) {
+        g_source_remove(call->ice_batch_source);
+        call->ice_batch_source = 0;
+    }
+    g_mutex_unlock(&call->ice_batch_lock);
+
+    if (batch)
+        send_ice_batch(call, batch);
+}
+
 static void
 send_ice_candidate_message(GstElement* webrtc G_GNUC_UNUSED, guint mlineindex,
-    gchar* candidate, gpointer user_data G_GNUC_UNUSED)
+    gchar* candidate, gpointer user_data)
 {
+    Call* call = user_data;
     gchar* text;
     JsonObject* ice, * msg;
 
-    if (app_state < PEER_CALL_NEGOTIATING) {
-        cleanup_and_quit_loop("Can't send ICE, not in call", APP_STATE_ERROR);
+    if (call->state < PEER_CALL_NEGOTIATING) {
+        end_call(call, "Can't send ICE, not in call", APP_STATE_ERROR);
         return;
     }
 
     ice = json_object_new();
     json_object_set_string_member(ice, "candidate", candidate);
     json_object_set_int_member(ice, "sdpMLineIndex", mlineindex);
+
+    if (ice_batch_ms > 0) {
+        /* The window opens with the first candidate; the timer fires on the
+         * main loop, which owns the websocket */
+        g_mutex_lock(&call->ice_batch_lock);
+        if (!call->ice_batch)
+            call->ice_batch = json_array_new();
+        json_array_add_object_element(call->ice_batch, ice);
+        if (!call->ice_batch_source)
+            call->ice_batch_source = g_timeout_add(ice_batch_ms, flush_ice_batch, call);
+        g_mutex_unlock(&call->ice_batch_lock);
+        return;
+    }
+
     msg = json_object_new();
     json_object_set_object_member(msg, "ice", ice);
     text = get_string_from_json_object(msg);
     json_object_unref(msg);
 
-    soup_websocket_connection_send_text(ws_conn, text);
+    send_to_peer(call, text);
     g_free(text);
 }
 
 static void
-send_sdp_to_peer(GstWebRTCSessionDescription* desc)
+add_remote_ice_candidate(Call* call, JsonNode* node)
+{
+    JsonObject* child;
+    const gchar* candidate;
+    gint sdpmlineindex;
+
+    if (!JSON_NODE_HOLDS_OBJECT(node))
+        return;
+
+    child = json_node_get_object(node);
+    candidate = json_object_get_string_member_with_default(child, "candidate", NULL);
+    sdpmlineindex = json_object_get_int_member_with_default(child, "sdpMLineIndex", -1);
+    if (!candidate || sdpmlineindex < 0 || !call->webrtc) {
+        gst_printerr("Ignoring malformed or early ICE candidate from %s\n",
+            call->peer_id ? call->peer_id : "peer");
+        return;
+    }
+
+    /* Add ice candidate sent by remote peer */
+    g_signal_emit_by_name(call->webrtc, "add-ice-candidate", sdpmlineindex,
+        candidate);
+}
+
+static void
+send_sdp_to_peer(Call* call, GstWebRTCSessionDescription* desc)
 {
     gchar* text;
     JsonObject* msg, * sdp;
 
-    if (app_state < PEER_CALL_NEGOTIATING) {
-        cleanup_and_quit_loop("Can't send SDP to peer, not in call",
+    if (call->state < PEER_CALL_NEGOTIATING) {
+        end_call(call, "Can't send SDP to peer, not in call",
             APP_STATE_ERROR);
         return;
     }
 
+    flush_ice_batch_now(call);
+
     text = gst_sdp_message_as_text(desc->sdp);
     sdp = json_object_new();
 
@@ -266,7 +494,7 @@ send_sdp_to_peer(GstWebRTCSessionDescription* desc)
     text = get_string_from_json_object(msg);
     json_object_unref(msg);
 
-    soup_websocket_connection_send_text(ws_conn, text);
+    send_to_peer(call, text);
     g_free(text);
 }
 
@@ -274,10 +502,11 @@ send_sdp_to_peer(GstWebRTCSessionDescription* desc)
 static void
 on_offer_created(GstPromise* promise, gpointer user_data)
 {
+    Call* call = user_data;
     GstWebRTCSessionDescription* offer = NULL;
     const GstStructure* reply;
 
-    g_assert_cmphex(app_state, == , PEER_CALL_NEGOTIATING);
+    g_assert_cmphex(call->state, == , PEER_CALL_NEGOTIATING);
 
     g_assert_cmphex(gst_promise_wait(promise), == , GST_PROMISE_RESULT_REPLIED);
     reply = gst_promise_get_reply(promise);
@@ -286,28 +515,28 @@ on_offer_created(GstPromise* promise, gpointer user_data)
     gst_promise_unref(promise);
 
     promise = gst_promise_new();
-    g_signal_emit_by_name(webrtc1, "set-local-description", offer, promise);
+    g_signal_emit_by_name(call->webrtc, "set-local-description", offer, promise);
     gst_promise_interrupt(promise);
     gst_promise_unref(promise);
 
     /* Send offer to peer */
-    send_sdp_to_peer(offer);
+    send_sdp_to_peer(call, offer);
     gst_webrtc_session_description_free(offer);
 }
 
 static void
 on_negotiation_needed(GstElement* element, gpointer user_data)
 {
-    gboolean create_offer = GPOINTER_TO_INT(user_data);
-    app_state = PEER_CALL_NEGOTIATING;
+    Call* call = user_data;
+    call->state = PEER_CALL_NEGOTIATING;
 
     if (remote_is_offerer) {
-        soup_websocket_connection_send_text(ws_conn, "OFFER_REQUEST");
+        send_to_peer(call, "OFFER_REQUEST");
     }
-    else if (create_offer) {
+    else if (call->create_offer) {
         GstPromise* promise =
-            gst_promise_new_with_change_func(on_offer_created, NULL, NULL);
-        g_signal_emit_by_name(webrtc1, "create-offer", NULL, promise);
+            gst_promise_new_with_change_func(on_offer_created, call, NULL);
+        g_signal_emit_by_name(element, "create-offer", NULL, promise);
     }
 }
 
@@ -318,7 +547,7 @@ on_negotiation_needed(GstElement* element, gpointer user_data)
 static void
 data_channel_on_error(GObject* dc, gpointer user_data)
 {
-    cleanup_and_quit_loop("Data channel error", 0);
+    end_call(user_data, "Data channel error", 0);
 }
 
 static void
@@ -334,7 +563,7 @@ data_channel_on_open(GObject* dc, gpointer user_data)
 static void
 data_channel_on_close(GObject* dc, gpointer user_data)
 {
-    cleanup_and_quit_loop("Data channel closed", 0);
+    end_call(user_data, "Data channel closed", 0);
 }
 
 static void
@@ -344,24 +573,25 @@ data_channel_on_message_string(GObject* dc, gchar* str, gpointer user_data)
 }
 
 static void
-connect_data_channel_signals(GObject* data_channel)
+connect_data_channel_signals(GObject* data_channel, Call* call)
 {
     g_signal_connect(data_channel, "on-error",
-        G_CALLBACK(data_channel_on_error), NULL);
+        G_CALLBACK(data_channel_on_error), call);
     g_signal_connect(data_channel, "on-open", G_CALLBACK(data_channel_on_open),
-        NULL);
+        call);
     g_signal_connect(data_channel, "on-close",
-        G_CALLBACK(data_channel_on_close), NULL);
+        G_CALLBACK(data_channel_on_close), call);
     g_signal_connect(data_channel, "on-message-string",
-        G_CALLBACK(data_channel_on_message_string), NULL);
+        G_CALLBACK(data_channel_on_message_string), call);
 }
 
 static void
 on_data_channel(GstElement* webrtc, GObject* data_channel,
     gpointer user_data)
 {
-    connect_data_channel_signals(data_channel);
-    receive_channel = data_channel;
+    Call* call = user_data;
+    connect_data_channel_signals(data_channel, call);
+    call->receive_channel = data_channel;
 }
 
 static void
@@ -386,7 +616,8 @@ on_ice_gathering_state_notify(GstElement* webrtcbin, GParamSpec* pspec,
     gst_print("ICE gathering state changed to %s\n", new_state);
 }
 
-static gboolean webrtcbin_get_stats(GstElement* webrtcbin);
+
+static gboolean webrtcbin_get_stats(gpointer user_data);
 
 static gboolean
 on_webrtcbin_stat(GQuark field_id, const GValue* value, gpointer unused)
@@ -404,8 +635,9 @@ on_webrtcbin_stat(GQuark field_id, const GValue* value, gpointer unused)
 }
 
 static void
-on_webrtcbin_get_stats(GstPromise* promise, GstElement* webrtcbin)
+on_webrtcbin_get_stats(GstPromise* promise, gpointer user_data)
 {
+    GstElement* webrtcbin = user_data;
     const GstStructure* stats;
 
     g_return_if_fail(gst_promise_wait(promise) == GST_PROMISE_RESULT_REPLIED);
@@ -413,17 +645,21 @@ on_webrtcbin_get_stats(GstPromise* promise, GstElement* webrtcbin)
     stats = gst_promise_get_reply(promise);
     gst_structure_foreach(stats, on_webrtcbin_stat, NULL);
 
-    g_timeout_add(100, (GSourceFunc)webrtcbin_get_stats, webrtcbin);
+    /* Polling holds a ref and stops once the call's pipeline has let go */
+    if (GST_OBJECT_PARENT(webrtcbin))
+        g_timeout_add_full(G_PRIORITY_DEFAULT, 100, webrtcbin_get_stats,
+            gst_object_ref(webrtcbin), gst_object_unref);
 }
 
 static gboolean
-webrtcbin_get_stats(GstElement* webrtcbin)
+webrtcbin_get_stats(gpointer user_data)
 {
+    GstElement* webrtcbin = user_data;
     GstPromise* promise;
 
     promise =
-        gst_promise_new_with_change_func(
-            (GstPromiseChangeFunc)on_webrtcbin_get_stats, webrtcbin, NULL);
+        gst_promise_new_with_change_func(on_webrtcbin_get_stats,
+            gst_object_ref(webrtcbin), gst_object_unref);
 
     GST_TRACE("emitting get-stats on %" GST_PTR_FORMAT, webrtcbin);
     g_signal_emit_by_name(webrtcbin, "get-stats", NULL, promise);
@@ -436,12 +672,12 @@ webrtcbin_get_stats(GstElement* webrtcbin)
 
 //переделать полностю
 static gboolean
-start_pipeline(gboolean create_offer)
+start_pipeline(Call* call, gboolean create_offer)
 {
     GstStateChangeReturn ret;
     GError* error = NULL;
 
-    pipe1 =
+    call->pipe =
         gst_parse_launch("webrtcbin bundle-policy=max-bundle name=sendrecv "
             STUN_SERVER
             "videotestsrc is-live=true pattern=ball ! videoconvert ! queue ! "
@@ -462,8 +698,8 @@ start_pipeline(gboolean create_offer)
         goto err;
     }
 
-    webrtc1 = gst_bin_get_by_name(GST_BIN(pipe1), "sendrecv");
-    g_assert_nonnull(webrtc1);
+    call->webrtc = gst_bin_get_by_name(GST_BIN(call->pipe), "sendrecv");
+    g_assert_nonnull(call->webrtc);
 
     if (remote_is_offerer) {
         /* XXX: this will fail when the remote offers twcc as the extension id
@@ -476,7 +712,7 @@ start_pipeline(gboolean create_offer)
         GstElement* videopay, * audiopay;
         GstRTPHeaderExtension* video_twcc, * audio_twcc;
 
-        videopay = gst_bin_get_by_name(GST_BIN(pipe1), "videopay");
+        videopay = gst_bin_get_by_name(GST_BIN(call->pipe), "videopay");
         g_assert_nonnull(videopay);
         video_twcc = gst_rtp_header_extension_create_from_uri(RTP_TWCC_URI);
         g_assert_nonnull(video_twcc);
@@ -485,7 +721,7 @@ start_pipeline(gboolean create_offer)
         g_clear_object(&video_twcc);
         g_clear_object(&videopay);
 
-        audiopay = gst_bin_get_by_name(GST_BIN(pipe1), "audiopay");
+        audiopay = gst_bin_get_by_name(GST_BIN(call->pipe), "audiopay");
         g_assert_nonnull(audiopay);
         audio_twcc = gst_rtp_header_extension_create_from_uri(RTP_TWCC_URI);
         g_assert_nonnull(audio_twcc);
@@ -497,50 +733,53 @@ start_pipeline(gboolean create_offer)
 
     /* This is the gstwebrtc entry point where we create the offer and so on. It
      * will be called when the pipeline goes to PLAYING. */
-    g_signal_connect(webrtc1, "on-negotiation-needed",
-        G_CALLBACK(on_negotiation_needed), GINT_TO_POINTER(create_offer));
+    call->create_offer = create_offer;
+    g_signal_connect(call->webrtc, "on-negotiation-needed",
+        G_CALLBACK(on_negotiation_needed), call);
     /* We need to transmit this ICE candidate to the browser via the websockets
      * signalling server. Incoming ice candidates from the browser need to be
      * added by us too, see on_server_message() */
-    g_signal_connect(webrtc1, "on-ice-candidate",
-        G_CALLBACK(send_ice_candidate_message), NULL);
-    g_signal_connect(webrtc1, "notify::ice-gathering-state",
+    g_signal_connect(call->webrtc, "on-ice-candidate",
+        G_CALLBACK(send_ice_candidate_message), call);
+    g_signal_connect(call->webrtc, "notify::ice-gathering-state",
         G_CALLBACK(on_ice_gathering_state_notify), NULL);
 
-    gst_element_set_state(pipe1, GST_STATE_READY);
+    gst_element_set_state(call->pipe, GST_STATE_READY);
 
-    g_signal_emit_by_name(webrtc1, "create-data-channel", "channel", NULL,
-        &send_channel);
-    if (send_channel) {
+    g_signal_emit_by_name(call->webrtc, "create-data-channel", "channel", NULL,
+        &call->send_channel);
+    if (call->send_channel) {
         gst_print("Created data channel\n");
-        connect_data_channel_signals(send_channel);
+        connect_data_channel_signals(call->send_channel, call);
     }
     else {
         gst_print("Could not create data channel, is usrsctp available?\n");
     }
 
-    g_signal_connect(webrtc1, "on-data-channel", G_CALLBACK(on_data_channel),
-        NULL);
+    g_signal_connect(call->webrtc, "on-data-channel", G_CALLBACK(on_data_channel),
+        call);
     /* Incoming streams will be exposed via this signal */
-    g_signal_connect(webrtc1, "pad-added", G_CALLBACK(on_incoming_stream),
-        pipe1);
-    /* Lifetime is the same as the pipeline itself */
-    gst_object_unref(webrtc1);
+    g_signal_connect(call->webrtc, "pad-added", G_CALLBACK(on_incoming_stream),
+        call->pipe);
 
-    g_timeout_add(100, (GSourceFunc)webrtcbin_get_stats, webrtc1);
+    g_timeout_add_full(G_PRIORITY_DEFAULT, 100, webrtcbin_get_stats,
+        gst_object_ref(call->webrtc), gst_object_unref);
+
+    /* Lifetime is the same as the pipeline itself */
+    gst_object_unref(call->webrtc);
 
     gst_print("Starting pipeline\n");
-    ret = gst_element_set_state(GST_ELEMENT(pipe1), GST_STATE_PLAYING);
+    ret = gst_element_set_state(GST_ELEMENT(call->pipe), GST_STATE_PLAYING);
     if (ret == GST_STATE_CHANGE_FAILURE)
         goto err;
 
     return TRUE;
 
 err:
-    if (pipe1)
-        g_clear_object(&pipe1);
-    if (webrtc1)
-        webrtc1 = NULL;
+    if (call->pipe)
+        g_clear_object(&call->pipe);
+    if (call->webrtc)
+        call->webrtc = NULL;
     return FALSE;
 }
 
@@ -564,6 +803,55 @@ setup_call(void)
     return TRUE;
 }
 
+/* --multiplex: no SESSION handshake, every listed peer gets a call right away;
+ * the server answers for a peer it does not know with FROM <peer> ERROR */
+static gboolean
+setup_multiplexed_calls(void)
+{
+    gchar** ids = g_strsplit(peer_id, ",", -1);
+    guint i;
+
+    for (i = 0; ids[i]; i++) {
+        Call* call;
+
+        if (!ids[i][0] || g_hash_table_contains(calls, ids[i]))
+            continue;
+
+        gst_print("Setting up multiplexed call with %s\n", ids[i]);
+        call = call_new(ids[i]);
+        call->state = PEER_CONNECTED;
+        g_hash_table_insert(calls, call->peer_id, call);
+        if (!start_pipeline(call, TRUE))
+            g_hash_table_remove(calls, ids[i]);
+    }
+    g_strfreev(ids);
+
+    return g_hash_table_size(calls) > 0;
+}
+
+/* --our-id --multiplex: a FROM for an unknown peer starts a call only if
+ * --peer-id lists that peer (or is *) and fewer than --max-calls are up */
+static gboolean
+accept_incoming_call(const gchar* id)
+{
+    gchar** allowed;
+    gboolean listed;
+
+    if (g_hash_table_size(calls) >= (guint)max_calls) {
+        gst_printerr("Already carrying %d calls, refusing %s\n", max_calls, id);
+        return FALSE;
+    }
+
+    allowed = g_strsplit(peer_id, ",", -1);
+    listed = g_strv_contains((const gchar* const*)allowed, "*") ||
+        g_strv_contains((const gchar* const*)allowed, id);
+    g_strfreev(allowed);
+
+    if (!listed)
+        gst_printerr("%s is not in --peer-id, refusing call\n", id);
+    return listed;
+}
+
 static gboolean
 register_with_server(void)
 {
@@ -609,10 +897,11 @@ on_server_closed(SoupWebsocketConnection* conn G_GNUC_UNUSED,
 static void
 on_answer_created(GstPromise* promise, gpointer user_data)
 {
+    Call* call = user_data;
     GstWebRTCSessionDescription* answer = NULL;
     const GstStructure* reply;
 
-    g_assert_cmphex(app_state, == , PEER_CALL_NEGOTIATING);
+    g_assert_cmphex(call->state, == , PEER_CALL_NEGOTIATING);
 
     g_assert_cmphex(gst_promise_wait(promise), == , GST_PROMISE_RESULT_REPLIED);
     reply = gst_promise_get_reply(promise);
@@ -621,25 +910,27 @@ on_answer_created(GstPromise* promise, gpointer user_data)
     gst_promise_unref(promise);
 
     promise = gst_promise_new();
-    g_signal_emit_by_name(webrtc1, "set-local-description", answer, promise);
+    g_signal_emit_by_name(call->webrtc, "set-local-description", answer, promise);
     gst_promise_interrupt(promise);
     gst_promise_unref(promise);
 
     /* Send answer to peer */
-    send_sdp_to_peer(answer);
+    send_sdp_to_peer(call, answer);
     gst_webrtc_session_description_free(answer);
 }
 
 static void
 on_offer_set(GstPromise* promise, gpointer user_data)
 {
+    Call* call = user_data;
+
     gst_promise_unref(promise);
-    promise = gst_promise_new_with_change_func(on_answer_created, NULL, NULL);
-    g_signal_emit_by_name(webrtc1, "create-answer", NULL, promise);
+    promise = gst_promise_new_with_change_func(on_answer_created, call, NULL);
+    g_signal_emit_by_name(call->webrtc, "create-answer", NULL, promise);
 }
 
 static void
-on_offer_received(GstSDPMessage* sdp)
+on_offer_received(Call* call, GstSDPMessage* sdp)
 {
     GstWebRTCSessionDescription* offer = NULL;
     GstPromise* promise;
@@ -649,12 +940,159 @@ on_offer_received(GstSDPMessage* sdp)
 
     /* Set remote description on our pipeline */
     {
-        promise = gst_promise_new_with_change_func(on_offer_set, NULL, NULL);
-        g_signal_emit_by_name(webrtc1, "set-remote-description", offer, promise);
+        promise = gst_promise_new_with_change_func(on_offer_set, call, NULL);
+        g_signal_emit_by_name(call->webrtc, "set-remote-description", offer, promise);
     }
     gst_webrtc_session_description_free(offer);
 }
 
+/* A message for one call: SDP and ICE, and with --multiplex also the peer's
+ * OFFER_REQUEST and the server's ERROR for a peer it could not reach */
+static void
+handle_call_message(Call* call, const gchar* text)
+{
+    JsonNode* root;
+    JsonObject* object, * child;
+    JsonParser* parser;
+
+    if (multiplex && g_strcmp0(text, "OFFER_REQUEST") == 0) {
+        if (call->webrtc) {
+            gst_printerr("Received OFFER_REQUEST at a strange time, ignoring\n");
+            return;
+        }
+        gst_print("Received OFFER_REQUEST from %s, sending offer\n", call->peer_id);
+        if (!start_pipeline(call, TRUE))
+            end_call(call, "ERROR: failed to start pipeline", PEER_CALL_ERROR);
+        return;
+    }
+    if (multiplex && g_str_has_prefix(text, "ERROR")) {
+        end_call(call, text, PEER_CALL_ERROR);
+        return;
+    }
+
+    /* Look for JSON messages containing SDP and ICE candidates */
+    parser = json_parser_new();
+    if (!json_parser_load_from_data(parser, text, -1, NULL)) {
+        gst_printerr("Unknown message '%s', ignoring\n", text);
+        g_object_unref(parser);
+        return;
+    }
+
+    root = json_parser_get_root(parser);
+    if (!JSON_NODE_HOLDS_OBJECT(root)) {
+        gst_printerr("Unknown json message '%s', ignoring\n", text);
+        g_object_unref(parser);
+        return;
+    }
+
+    /* If peer connection wasn't made yet and we are expecting peer will
+     * connect to us, launch pipeline at this moment */
+    if (!call->webrtc && our_id) {
+        if (!start_pipeline(call, FALSE)) {
+            end_call(call, "ERROR: failed to start pipeline",
+                PEER_CALL_ERROR);
+            g_object_unref(parser);
+            return;
+        }
+
+        call->state = PEER_CALL_NEGOTIATING;
+    }
+
+    object = json_node_get_object(root);
+    /* Check type of JSON message */
+    if (json_object_has_member(object, "sdp")) {
+        int ret;
+        GstSDPMessage* sdp;
+        const gchar* text, * sdptype;
+        GstWebRTCSessionDescription* answer;
+
+        if (call->state != PEER_CALL_NEGOTIATING) {
+            end_call(call, "ERROR: received SDP while not negotiating",
+                PEER_CALL_ERROR);
+            g_object_unref(parser);
+            return;
+        }
+
+        if (!JSON_NODE_HOLDS_OBJECT(json_object_get_member(object, "sdp"))) {
+            end_call(call, "ERROR: received 'sdp' that is not an object",
+                PEER_CALL_ERROR);
+            g_object_unref(parser);
+            return;
+        }
+        child = json_object_get_object_member(object, "sdp");
+
+        sdptype = json_object_get_string_member_with_default(child, "type", NULL);
+        if (!sdptype) {
+            end_call(call, "ERROR: received SDP without 'type'",
+                PEER_CALL_ERROR);
+            g_object_unref(parser);
+            return;
+        }
+
+        /* In this example, we create the offer and receive one answer by default,
+         * but it's possible to comment out the offer creation and wait for an offer
+         * instead, so we handle either here.
+         *
+         * See tests/examples/webrtcbidirectional.c in gst-plugins-bad for another
+         * example how to handle offers from peers and reply with answers using webrtcbin. */
+        text = json_object_get_string_member_with_default(child, "sdp", NULL);
+        if (!text) {
+            end_call(call, "ERROR: received SDP without 'sdp'",
+                PEER_CALL_ERROR);
+            g_object_unref(parser);
+            return;
+        }
+        gst_sdp_message_new(&sdp);
+        ret = gst_sdp_message_parse_buffer((guint8*)text, strlen(text), sdp);
+        if (ret != GST_SDP_OK) {
+            gst_sdp_message_free(sdp);
+            end_call(call, "ERROR: received unparseable SDP", PEER_CALL_ERROR);
+            g_object_unref(parser);
+            return;
+        }
+
+        if (g_str_equal(sdptype, "answer")) {
+            gst_print("Received answer:\n%s\n", text);
+            answer = gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_ANSWER,
+                sdp);
+            g_assert_nonnull(answer);
+
+            /* Set remote description on our pipeline */
+            {
+                GstPromise* promise = gst_promise_new();
+                g_signal_emit_by_name(call->webrtc, "set-remote-description", answer,
+                    promise);
+                gst_promise_interrupt(promise);
+                gst_promise_unref(promise);
+            }
+            call->state = PEER_CALL_STARTED;
+        }
+        else {
+            gst_print("Received offer:\n%s\n", text);
+            on_offer_received(call, sdp);
+        }
+
+    }
+    else if (json_object_has_member(object, "ice")) {
+        JsonNode* ice = json_object_get_member(object, "ice");
+
+        /* Either one candidate or a batch of them */
+        if (JSON_NODE_HOLDS_ARRAY(ice)) {
+            JsonArray* batch = json_node_get_array(ice);
+            guint i;
+            for (i = 0; i < json_array_get_length(batch); i++)
+                add_remote_ice_candidate(call, json_array_get_element(batch, i));
+        }
+        else {
+            add_remote_ice_candidate(call, ice);
+        }
+    }
+    else {
+        gst_printerr("Ignoring unknown JSON message:\n%s\n", text);
+    }
+    g_object_unref(parser);
+}
+
 /* One mega message handler for our asynchronous calling mechanism */
 static void
 on_server_message(SoupWebsocketConnection* conn, SoupWebsocketDataType type,
@@ -688,7 +1126,7 @@ on_server_message(SoupWebsocketConnection* conn, SoupWebsocketDataType type,
         gst_print("Registered with server\n");
         if (!our_id) {
             /* Ask signalling server to connect us with a specific peer */
-            if (!setup_call()) {
+            if (multiplex ? !setup_multiplexed_calls() : !setup_call()) {
                 cleanup_and_quit_loop("ERROR: Failed to setup call", PEER_CALL_ERROR);
                 goto out;
             }
@@ -708,24 +1146,24 @@ on_server_message(SoupWebsocketConnection* conn, SoupWebsocketDataType type,
 
         app_state = PEER_CONNECTED;
         /* Start negotiation (exchange SDP and ICE candidates) */
-        if (!start_pipeline(TRUE))
+        if (!start_pipeline(single_call, TRUE))
             cleanup_and_quit_loop("ERROR: failed to start pipeline",
                 PEER_CALL_ERROR);
     }
-    else if (g_strcmp0(text, "OFFER_REQUEST") == 0) {
+    else if (!multiplex && g_strcmp0(text, "OFFER_REQUEST") == 0) {
         if (app_state != SERVER_REGISTERED) {
             gst_printerr("Received OFFER_REQUEST at a strange time, ignoring\n");
             goto out;
         }
         gst_print("Received OFFER_REQUEST, sending offer\n");
         /* Peer wants us to start negotiation (exchange SDP and ICE candidates) */
-        if (!start_pipeline(TRUE))
+        if (!start_pipeline(single_call, TRUE))
             cleanup_and_quit_loop("ERROR: failed to start pipeline",
                 PEER_CALL_ERROR);
     }
     else if (g_str_has_prefix(text, "ERROR")) {
-        /* Handle errors */
-        switch (app_state) {
+        /* Handle errors; the call's own state says how far negotiation got */
+        switch (single_call && single_call->state ? single_call->state : app_state) {
         case SERVER_CONNECTING:
             app_state = SERVER_CONNECTION_ERROR;
             break;
@@ -744,104 +1182,36 @@ on_server_message(SoupWebsocketConnection* conn, SoupWebsocketDataType type,
         }
         cleanup_and_quit_loop(text, 0);
     }
-    else {
-        /* Look for JSON messages containing SDP and ICE candidates */
-        JsonNode* root;
-        JsonObject* object, * child;
-        JsonParser* parser = json_parser_new();
-        if (!json_parser_load_from_data(parser, text, -1, NULL)) {
-            gst_printerr("Unknown message '%s', ignoring\n", text);
-            g_object_unref(parser);
+    else if (multiplex && g_str_has_prefix(text, "FROM ")) {
+        /* Dispatch to the call for that peer; with --our-id a new peer is a new call */
+        const gchar* from = text + 5;
+        const gchar* payload = strchr(from, ' ');
+        gchar* id;
+        Call* call;
+
+        if (!payload) {
+            gst_printerr("Malformed message '%s', ignoring\n", text);
             goto out;
         }
 
-        root = json_parser_get_root(parser);
-        if (!JSON_NODE_HOLDS_OBJECT(root)) {
-            gst_printerr("Unknown json message '%s', ignoring\n", text);
-            g_object_unref(parser);
-            goto out;
-        }
-
-        /* If peer connection wasn't made yet and we are expecting peer will
-         * connect to us, launch pipeline at this moment */
-        if (!webrtc1 && our_id) {
-            if (!start_pipeline(FALSE)) {
-                cleanup_and_quit_loop("ERROR: failed to start pipeline",
-                    PEER_CALL_ERROR);
-            }
-
-            app_state = PEER_CALL_NEGOTIATING;
+        id = g_strndup(from, payload - from);
+        call = g_hash_table_lookup(calls, id);
+        if (!call && our_id && accept_incoming_call(id)) {
+            gst_print("Incoming multiplexed call from %s\n", id);
+            call = call_new(id);
+            g_hash_table_insert(calls, call->peer_id, call);
         }
-
-        object = json_node_get_object(root);
-        /* Check type of JSON message */
-        if (json_object_has_member(object, "sdp")) {
-            int ret;
-            GstSDPMessage* sdp;
-            const gchar* text, * sdptype;
-            GstWebRTCSessionDescription* answer;
-
-            g_assert_cmphex(app_state, == , PEER_CALL_NEGOTIATING);
-
-            child = json_object_get_object_member(object, "sdp");
-
-            if (!json_object_has_member(child, "type")) {
-                cleanup_and_quit_loop("ERROR: received SDP without 'type'",
-                    PEER_CALL_ERROR);
-                goto out;
-            }
-
-            sdptype = json_object_get_string_member(child, "type");
-            /* In this example, we create the offer and receive one answer by default,
-             * but it's possible to comment out the offer creation and wait for an offer
-             * instead, so we handle either here.
-             *
-             * See tests/examples/webrtcbidirectional.c in gst-plugins-bad for another
-             * example how to handle offers from peers and reply with answers using webrtcbin. */
-            text = json_object_get_string_member(child, "sdp");
-            ret = gst_sdp_message_new(&sdp);
-            g_assert_cmphex(ret, == , GST_SDP_OK);
-            ret = gst_sdp_message_parse_buffer((guint8*)text, strlen(text), sdp);
-            g_assert_cmphex(ret, == , GST_SDP_OK);
-
-            if (g_str_equal(sdptype, "answer")) {
-                gst_print("Received answer:\n%s\n", text);
-                answer = gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_ANSWER,
-                    sdp);
-                g_assert_nonnull(answer);
-
-                /* Set remote description on our pipeline */
-                {
-                    GstPromise* promise = gst_promise_new();
-                    g_signal_emit_by_name(webrtc1, "set-remote-description", answer,
-                        promise);
-                    gst_promise_interrupt(promise);
-                    gst_promise_unref(promise);
-                }
-                app_state = PEER_CALL_STARTED;
-            }
-            else {
-                gst_print("Received offer:\n%s\n", text);
-                on_offer_received(sdp);
-            }
-
-        }
-        else if (json_object_has_member(object, "ice")) {
-            const gchar* candidate;
-            gint sdpmlineindex;
-
-            child = json_object_get_object_member(object, "ice");
-            candidate = json_object_get_string_member(child, "candidate");
-            sdpmlineindex = json_object_get_int_member(child, "sdpMLineIndex");
-
-            /* Add ice candidate sent by remote peer */
-            g_signal_emit_by_name(webrtc1, "add-ice-candidate", sdpmlineindex,
-                candidate);
-        }
-        else {
-            gst_printerr("Ignoring unknown JSON message:\n%s\n", text);
-        }
-        g_object_unref(parser);
+        if (call)
+            handle_call_message(call, payload + 1);
+        else
+            gst_printerr("Message from %s, who we are not calling, ignoring\n", id);
+        g_free(id);
+    }
+    else if (!multiplex) {
+        handle_call_message(single_call, text);
+    }
+    else {
+        gst_printerr("Unaddressed message '%s', ignoring\n", text);
     }
 
 out:
@@ -864,7 +1234,8 @@ on_server_connected(SoupSession* session, GAsyncResult* res,
     g_assert_nonnull(ws_conn);
 
     app_state = SERVER_CONNECTED;
-    gst_print("Connected to signalling server\n");
+    gst_print("Connected to signalling server%s\n",
+        soup_websocket_connection_get_extensions(ws_conn) ? " (permessage-deflate)" : "");
 
     g_signal_connect(ws_conn, "closed", G_CALLBACK(on_server_closed), NULL);
     g_signal_connect(ws_conn, "message", G_CALLBACK(on_server_message), NULL);
@@ -890,6 +1261,10 @@ connect_to_websocket_server_async(void)
             //SOUP_SESSION_SSL_CA_FILE, "/etc/ssl/certs/ca-bundle.crt",
             SOUP_SESSION_HTTPS_ALIASES, https_aliases, NULL);
 
+    /* libsoup offers permessage-deflate by default; keep it opt-in */
+    if (!compress_signaling)
+        soup_session_remove_feature_by_type(session, SOUP_TYPE_WEBSOCKET_EXTENSION_DEFLATE);
+
     logger = soup_logger_new(SOUP_LOGGER_LOG_BODY, -1);
     soup_session_add_feature(session, SOUP_SESSION_FEATURE(logger));
     g_object_unref(logger);
@@ -929,6 +1304,7 @@ check_plugins(void)
     return ret;
 }
 
+
 int
 main(int argc, char* argv[])
 {
@@ -956,11 +1332,27 @@ main(int argc, char* argv[])
         goto out;
     }
 
-    if (peer_id && our_id) {
+    if (peer_id && our_id && !multiplex) {
         gst_printerr("specify only --peer-id or --our-id\n");
         goto out;
     }
 
+    if (our_id && multiplex && !peer_id) {
+        gst_printerr("--our-id with --multiplex needs --peer-id listing the "
+            "peers allowed to call (or *)\n");
+        goto out;
+    }
+
+    if (max_calls < 1) {
+        gst_printerr("--max-calls must be at least 1\n");
+        goto out;
+    }
+
+    if (multiplex)
+        calls = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, call_free);
+    else
+        single_call = call_new(peer_id);
+
     ret_code = 0;
 
     /* Disable ssl when running a localhost server, because
@@ -982,11 +1374,8 @@ main(int argc, char* argv[])
     if (loop)
         g_main_loop_unref(loop);
 
-    if (pipe1) {
-        gst_element_set_state(GST_ELEMENT(pipe1), GST_STATE_NULL);
-        gst_print("Pipeline stopped\n");
-        gst_object_unref(pipe1);
-    }
+    g_clear_pointer(&calls, g_hash_table_destroy);
+    g_clear_pointer(&single_call, call_free);
 
 out:
     g_free(peer_id);
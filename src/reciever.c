@@ -5,6 +5,15 @@
  *  - libsoup 3.x (websocket_connect_async has io_priority)
  *  - explicit H.264 receive chain:
  *      webrtcbin -> queue -> rtph264depay -> h264parse -> avdec_h264 -> videoconvert -> autovideosink
+ *    (--sink swaps the tail for fakesink, appsink, shmsink, or stops after h264parse)
+ *  - a dropped signaling connection is redialled with jittered backoff; sessions
+ *    keep playing, and one whose sender re-offers is rebuilt
+ *  - --nack/--fec: answer with RTX and ULPFEC/RED; with --nack, gaps that survive
+ *    retransmission wait for a PLI-driven keyframe instead of decoding smeared
+ *  - --adaptive-jitter sizes the jitterbuffer and rxq from measured jitter
+ *  - --record=DIR tees the parsed stream into rotating MP4/Matroska files, no decode
+ *  - one Session (own pipeline + webrtcbin) per remote peer; messages tagged with
+ *    "peer" pick the session, untagged ones go to the default session ""
  */
 
 #include <gst/gst.h>
@@ -17,30 +26,141 @@
 
 #include <string.h>
 
+#include "backoff.h"
+#include "convert.h"
+#include "jitter.h"
+#include "latency_stamp.h"
+#include "signaling.h"
+#include "signaling_queue.h"
+#include "timeline.h"
+
+typedef enum {
+    NEGOTIATION_NEW = 0,
+    NEGOTIATION_OFFER_RECEIVED, /* remote offer applied, answer in flight */
+    NEGOTIATION_STABLE,         /* answer sent */
+} NegotiationState;
+
+typedef struct {
+    gint64 created_us;
+    guint sdp_sent;
+    guint sdp_received;
+    guint ice_sent;
+    guint ice_received;
+    guint ice_frames_sent;      /* < ice_sent when batching */
+    gsize bytes_sent;           /* signaling payload sent, before any deflate */
+    gsize bytes_received;
+    gint64 send_us;             /* time libsoup spent sending its frames (and deflating) */
+} SessionStats;
+
+/* Remote candidate that arrived before the offer it belongs to */
+typedef struct {
+    guint mlineindex;
+    gchar* candidate;
+} PendingIce;
+
+/*
+ * One Session per remote peer. Each session owns a small pipeline (webrtcbin +
+ * rxbin), so a failing call never takes the others down and teardown is just
+ * NULL + unref. Sessions are only mutated from the main loop.
+ */
+typedef struct {
+    gchar* id;
+    GstElement* pipep;
+    GstElement* webrtc;
+    gboolean video_chain_built;
+    NegotiationState state;
+    GQueue pending_ice;             /* PendingIce*, flushed once the offer is set */
+    GString* ice_batch;             /* local candidates waiting for the batch timer */
+    gboolean ice_batch_binary;      /* format the batch items were written in */
+    guint ice_batch_count;
+    guint ice_batch_source;
+    SessionStats stats;
+    Timeline timeline;
+    gboolean timeline_reported;
+    gboolean peer_left;             /* announced as left while its media was up */
+    LatencyStampMap* capture_times; /* --measure-latency: depay sink -> decoder src */
+    LatencyStats* latency;
+    GString* latency_text;
+    guint decoder_threads;          /* granted from the process budget */
+    gint frames_delivered;          /* atomic; --sink=appsink */
+    GstElement* rxq;                /* --adaptive-jitter resizes it */
+    JitterTuner jitter;
+    GstElement* recq;               /* --record: branch queue, leaks on a slow disk */
+    gint recq_in;                   /* atomic; buffers into and out of recq */
+    gint recq_out;
+    gint recq_leaked_reported;      /* splitmuxsink's streaming thread */
+    gint recq_segment;              /* atomic; fragment being written */
+} Session;
+
  /* ---------- Globals ---------- */
 static GMainLoop* loop = NULL;
-static GstElement* pipep = NULL;
-static GstElement* webrtc = NULL;
+static GHashTable* sessions = NULL; /* peer id -> Session* */
+static GHashTable* early_ice = NULL; /* peer id -> EarlyIce*, candidates ahead of the offer */
 
 static SoupWebsocketConnection* ws_conn = NULL;
+static gint64 ws_connected_us = 0;  /* copied into every session's timeline */
+static gboolean ws_deflate = FALSE; /* permessage-deflate negotiated on ws_conn */
+static SignalingQueue tx_queue;     /* outbound frames; holds them while disconnected */
+
+/* Redial the signaling server instead of quitting; media is not touched */
+#define RECONNECT_BASE_MS 500
+#define RECONNECT_MAX_MS  30000
+static gboolean reconnect = TRUE;
+static Backoff reconnect_backoff;
+static guint reconnect_source = 0;
 
 static gchar* server_url = "wss://108.130.0.118:8080";
 static gboolean disable_ssl = TRUE; /* currently not wired for libsoup3 self-signed handling */
 
-static gboolean video_chain_built = FALSE;
+/* Inbound scratch buffers: grown once, reused for every message */
+static GString* rx_peer = NULL;
+static GString* rx_text = NULL;
 
-/* ---------- Helpers: JSON stringify ---------- */
-static gchar*
-json_object_to_string(JsonObject* object)
-{
-    JsonNode* root = json_node_init_object(json_node_alloc(), object);
-    JsonGenerator* gen = json_generator_new();
-    json_generator_set_root(gen, root);
-    gchar* text = json_generator_to_data(gen, NULL);
-    g_object_unref(gen);
-    json_node_free(root);
-    return text;
-}
+/* Outbound buffer: every envelope is written into it and sent from it */
+static GString* tx_text = NULL;
+
+/* Coalesce local candidates for this long into one {"ice":[...]} frame; 0 = off */
+static gint ice_batch_ms = 0;
+
+/* Offer the binary signaling subprotocol; the server's pick decides per connection */
+static gboolean binary_signaling = FALSE;
+static gboolean compress_signaling = FALSE;
+
+/* Read the sender's --stamp-frames capture time back after decode */
+static gboolean measure_latency = FALSE;
+#define LATENCY_REPORT_FRAMES 300
+
+/* avdec_h264 threading: 0 threads = by resolution; "slice" adds no latency,
+ * "frame" adds one frame per thread but scales on single-slice streams.
+ * --decode-low-delay pins "slice" so at most one frame is in flight. */
+static gint decode_threads = 0;
+static gchar* decode_threading = "slice";
+static gboolean decode_low_delay = FALSE;
+static gint decoder_thread_budget = 0; /* 0 = one per core */
+
+/* What the receive chain ends in; see describe_sink() */
+static gchar* sink_name = "display";
+static gchar* sink_path = "/tmp/receiver";
+
+/* Passthrough recording; see describe_recording() */
+static gchar* record_dir = NULL;
+static gchar* record_format = "mp4";
+static gint record_segment_s = 300;
+
+/* Loss recovery the answer agrees to: retransmissions and ULPFEC/RED */
+static gboolean nack = FALSE;
+static gboolean fec = FALSE;
+
+/* Jitterbuffer latency and rxq depth from inbound-rtp stats, within bounds */
+static gboolean adaptive_jitter = FALSE;
+static gint jitter_min_ms = 20;
+static gint jitter_max_ms = 400;
+static gint queue_min_buffers = 10;
+static gint queue_max_buffers = 200;
+static guint jitter_source = 0;
+
+static GMutex decoder_budget_lock;
+static guint decoder_threads_used = 0;
 
 /* ---------- Cleanup ---------- */
 static gboolean
@@ -49,6 +169,9 @@ cleanup_and_quit(const gchar* msg)
     if (msg)
         g_printerr("%s\n", msg);
 
+    g_clear_handle_id(&jitter_source, g_source_remove);
+    g_clear_handle_id(&reconnect_source, g_source_remove);
+
     if (ws_conn) {
         if (soup_websocket_connection_get_state(ws_conn) == SOUP_WEBSOCKET_STATE_OPEN)
             soup_websocket_connection_close(ws_conn, 1000, "");
@@ -56,11 +179,12 @@ cleanup_and_quit(const gchar* msg)
             g_clear_object(&ws_conn);
     }
 
-    if (pipep) {
-        gst_element_set_state(pipep, GST_STATE_NULL);
-        g_clear_object(&pipep);
-        webrtc = NULL;
-    }
+    if (loop)
+        g_print("[receiver] Signaling queue: %s\n", signaling_queue_write_report(&tx_queue, tx_text));
+    signaling_queue_clear(&tx_queue);
+
+    g_clear_pointer(&sessions, g_hash_table_destroy);
+    g_clear_pointer(&early_ice, g_hash_table_destroy);
 
     if (loop) {
         g_main_loop_quit(loop);
@@ -70,13 +194,572 @@ cleanup_and_quit(const gchar* msg)
     return G_SOURCE_REMOVE;
 }
 
+/* ---------- Connection-setup timeline ---------- */
+static void
+report_timeline(Session* session)
+{
+    if (session->timeline_reported)
+        return;
+    session->timeline_reported = TRUE;
+    g_print("[receiver] timeline %s\n",
+        timeline_write_json(&session->timeline, tx_text, "receiver", session->id));
+}
+
+static gboolean
+report_timeline_by_id(gpointer data)
+{
+    Session* session = sessions ? g_hash_table_lookup(sessions, data) : NULL;
+
+    if (session)
+        report_timeline(session);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+on_ice_connection_state(GstElement* webrtcbin, GParamSpec* pspec, gpointer user_data)
+{
+    (void)pspec;
+    Session* session = user_data;
+    GstWebRTCICEConnectionState state;
+
+    g_object_get(webrtcbin, "ice-connection-state", &state, NULL);
+    if (state == GST_WEBRTC_ICE_CONNECTION_STATE_CONNECTED ||
+        state == GST_WEBRTC_ICE_CONNECTION_STATE_COMPLETED)
+        timeline_mark(&session->timeline, TIMELINE_ICE_CONNECTED);
+}
+
+static void remove_session(const gchar* peer_id);
+
+/* Main loop: a peer that left signaling goes once its media is gone too */
+static gboolean
+reap_left_session(gpointer data)
+{
+    const gchar* peer_id = data;
+    Session* session = sessions ? g_hash_table_lookup(sessions, peer_id) : NULL;
+
+    if (session && session->peer_left)
+        remove_session(peer_id);
+    return G_SOURCE_REMOVE;
+}
+
+/* The peer connection only reports "connected" once DTLS is done on top of ICE */
+static void
+on_connection_state(GstElement* webrtcbin, GParamSpec* pspec, gpointer user_data)
+{
+    (void)pspec;
+    Session* session = user_data;
+    GstWebRTCPeerConnectionState state;
+
+    g_object_get(webrtcbin, "connection-state", &state, NULL);
+    if (state == GST_WEBRTC_PEER_CONNECTION_STATE_CONNECTED)
+        timeline_mark(&session->timeline, TIMELINE_DTLS_CONNECTED);
+    else if (state == GST_WEBRTC_PEER_CONNECTION_STATE_DISCONNECTED ||
+             state == GST_WEBRTC_PEER_CONNECTION_STATE_FAILED ||
+             state == GST_WEBRTC_PEER_CONNECTION_STATE_CLOSED)
+        g_idle_add_full(G_PRIORITY_DEFAULT, reap_left_session, g_strdup(session->id), g_free);
+}
+
+/* Streaming thread: first depacketizable RTP out of webrtcbin */
+static GstPadProbeReturn
+on_first_rtp(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    (void)pad;
+    (void)info;
+    Session* session = user_data;
+
+    timeline_mark(&session->timeline, TIMELINE_FIRST_RTP);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+/* Streaming thread: first decoded picture closes the timeline */
+static GstPadProbeReturn
+on_first_frame(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    (void)pad;
+    (void)info;
+    Session* session = user_data;
+
+    timeline_mark(&session->timeline, TIMELINE_FIRST_FRAME);
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT,
+        report_timeline_by_id, g_strdup(session->id), g_free);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+/* ---------- Glass-to-glass latency (--measure-latency) ---------- */
+/* Streaming thread: RTP still intact, PTS already set by the jitterbuffer */
+static GstPadProbeReturn
+on_stamped_rtp(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    (void)pad;
+    Session* session = user_data;
+
+    gint64 capture_us;
+    GstBuffer* buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (latency_stamp_read(buffer, &capture_us))
+        latency_stamp_map_put(session->capture_times, GST_BUFFER_PTS(buffer), capture_us);
+    return GST_PAD_PROBE_OK;
+}
+
+/* Streaming thread: avdec_h264 keeps the PTS of the access unit it decoded */
+static GstPadProbeReturn
+on_decoded(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    (void)pad;
+    Session* session = user_data;
+
+    gint64 capture_us;
+    if (!latency_stamp_map_lookup(session->capture_times,
+        GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info)), &capture_us))
+        return GST_PAD_PROBE_OK;
+
+    latency_stats_add(session->latency, g_get_real_time() - capture_us);
+    if (latency_stats_count(session->latency) % LATENCY_REPORT_FRAMES == 0)
+        g_print("[receiver] latency '%s' %s\n", session->id,
+            latency_stats_write_json(session->latency, session->latency_text));
+    return GST_PAD_PROBE_OK;
+}
+
+static void
+add_latency_probes(Session* session, GstElement* rxbin)
+{
+    GstElement* depay = gst_bin_get_by_name(GST_BIN(rxbin), "depay");
+    GstElement* dec = gst_bin_get_by_name(GST_BIN(rxbin), "dec");
+
+    if (depay && dec) {
+        session->capture_times = latency_stamp_map_new();
+        session->latency = latency_stats_new();
+        session->latency_text = g_string_sized_new(128);
+
+        GstPad* pad = gst_element_get_static_pad(depay, "sink");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_stamped_rtp, session, NULL);
+        gst_object_unref(pad);
+
+        pad = gst_element_get_static_pad(dec, "src");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_decoded, session, NULL);
+        gst_object_unref(pad);
+    }
+
+    gst_clear_object(&depay);
+    gst_clear_object(&dec);
+}
+
+/* ---------- Decoder threading ---------- */
+/* Below ~VGA the hand-off costs more than a second thread saves */
+static guint
+decoder_threads_for(gint width, gint height)
+{
+    gint64 pixels = (gint64)width * height;
+
+    if (pixels <= 640 * 480)
+        return 1;
+    if (pixels <= 1280 * 720)
+        return 2;
+    if (pixels <= 1920 * 1080)
+        return 4;
+    return 6;
+}
+
+/* Swaps the session's previous grant for a new one; every decoder gets at
+ * least one thread even when the budget is spent. *in_use is the budget's
+ * total right after this grant. */
+static guint
+claim_decoder_threads(Session* session, guint wanted, guint* in_use)
+{
+    g_mutex_lock(&decoder_budget_lock);
+    decoder_threads_used -= session->decoder_threads;
+    guint left = (guint)decoder_thread_budget > decoder_threads_used
+        ? (guint)decoder_thread_budget - decoder_threads_used : 0;
+    session->decoder_threads = CLAMP(wanted, 1, MAX(left, 1));
+    decoder_threads_used += session->decoder_threads;
+    *in_use = decoder_threads_used;
+    g_mutex_unlock(&decoder_budget_lock);
+
+    return session->decoder_threads;
+}
+
+/* Streaming thread: avdec_h264 opens the codec on caps, so threading set
+ * here (size known from h264parse) applies to this stream */
+static GstPadProbeReturn
+on_decoder_caps(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    Session* session = user_data;
+    GstEvent* event = GST_PAD_PROBE_INFO_EVENT(info);
+
+    if (GST_EVENT_TYPE(event) != GST_EVENT_CAPS)
+        return GST_PAD_PROBE_OK;
+
+    GstCaps* caps;
+    gint width = 0, height = 0;
+    gst_event_parse_caps(event, &caps);
+    const GstStructure* s = gst_caps_get_structure(caps, 0);
+    gst_structure_get_int(s, "width", &width);
+    gst_structure_get_int(s, "height", &height);
+
+    guint wanted = decode_threads > 0 ? (guint)decode_threads : decoder_threads_for(width, height);
+    guint in_use;
+    guint threads = claim_decoder_threads(session, wanted, &in_use);
+
+    GstElement* dec = gst_pad_get_parent_element(pad);
+    if (dec) {
+        g_object_set(dec, "max-threads", (gint)threads, NULL);
+        if (g_strcmp0(decode_threading, "auto") != 0)
+            gst_util_set_object_arg(G_OBJECT(dec), "thread-type", decode_threading);
+        gst_object_unref(dec);
+    }
+
+    g_print("[receiver] '%s' decoding %dx%d with %u %s thread%s%s (%u/%d in use)\n",
+        session->id, width, height, threads, decode_threading, threads == 1 ? "" : "s",
+        decode_low_delay ? ", low-delay" : "", in_use, decoder_thread_budget);
+    return GST_PAD_PROBE_OK;
+}
+
+/* ---------- Sinks ---------- */
+#define FILE_STEM_MAX 64
+
+/* Peer ids come off the wire. Before one names a file or socket it is cut to
+ * [A-Za-z0-9_-]: no quotes, no "..", no '/' and no '%' for splitmuxsink's
+ * format. A hash of the original keeps ids that only differ elsewhere apart. */
+static gchar*
+session_file_stem(const Session* session)
+{
+    if (!session->id[0])
+        return g_strdup("default");
+
+    GString* stem = g_string_new(NULL);
+    gboolean changed = FALSE;
+    for (const gchar* c = session->id; *c; c++) {
+        if (stem->len == FILE_STEM_MAX) {
+            changed = TRUE;
+            break;
+        }
+        if (g_ascii_isalnum(*c) || *c == '_' || *c == '-') {
+            g_string_append_c(stem, *c);
+        }
+        else {
+            g_string_append_c(stem, '_');
+            changed = TRUE;
+        }
+    }
+    if (changed)
+        g_string_append_printf(stem, "-%08x", g_str_hash(session->id));
+    return g_string_free(stem, FALSE);
+}
+
+/* Streaming thread: the in-process analytics hook. Frames arrive in the
+ * decoder's format; the latest one is all appsink keeps (drop=true). */
+static GstFlowReturn
+on_analytics_sample(GstElement* appsink, gpointer user_data)
+{
+    Session* session = user_data;
+    GstSample* sample = NULL;
+
+    g_signal_emit_by_name(appsink, "pull-sample", &sample);
+    if (!sample)
+        return GST_FLOW_EOS;
+
+    g_atomic_int_inc(&session->frames_delivered);
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+/*
+ * Everything after h264parse:
+ *   display  avdec_h264 ! videoconvert ! autovideosink (needs a display)
+ *   fake     avdec_h264 ! fakesink      (decode cost only, for load tests)
+ *   appsink  avdec_h264 ! appsink       (frames handed to on_analytics_sample)
+ *   shm      avdec_h264 ! shmsink       (raw frames to <sink-path>-<peer>.sock, set
+ *                                        on the element: the peer id is not parsed)
+ *   none     fakesink                   (no decode at all: monitoring probes)
+ */
+static gchar*
+describe_sink(void)
+{
+    if (g_strcmp0(sink_name, "none") == 0)
+        return g_strdup("fakesink name=vsink sync=false");
+    if (g_strcmp0(sink_name, "fake") == 0)
+        return g_strdup("avdec_h264 name=dec ! fakesink name=vsink sync=false");
+    if (g_strcmp0(sink_name, "appsink") == 0)
+        return g_strdup("avdec_h264 name=dec ! "
+            "appsink name=vsink sync=false max-buffers=1 drop=true emit-signals=true");
+    if (g_strcmp0(sink_name, "shm") == 0)
+        return g_strdup("avdec_h264 name=dec ! "
+            "shmsink name=vsink wait-for-connection=false sync=false");
+
+    /* conv is passthrough when the sink takes the decoder's format */
+    return g_strdup_printf("avdec_h264 name=dec ! "
+        "videoconvert name=conv n-threads=%u ! "
+        "autovideosink name=vsink sync=false",
+        convert_threads(1));
+}
+
+/* ---------- Recording ---------- */
+/*
+ * The parsed elementary stream is remuxed as received: a tee after h264parse
+ * feeds splitmuxsink, which starts a new file at the first keyframe past
+ * --record-segment. Both formats are written so that a file cut short by
+ * teardown stays playable: fragmented MP4 (moof every second) or streamable
+ * Matroska (no seek back for cues).
+ *
+ * The branch queue leaks rather than stalling display on a slow disk; what
+ * it drops is counted and reported with the segment it is missing from.
+ */
+static gchar*
+describe_recording(void)
+{
+    /* location is set on the element, never parsed: see configure_recording() */
+    return g_strdup_printf(
+        "rectee. ! queue name=recq "
+        "max-size-buffers=0 max-size-bytes=33554432 max-size-time=0 leaky=downstream ! "
+        "splitmuxsink name=rec max-size-time=%" G_GUINT64_FORMAT,
+        (guint64)record_segment_s * GST_SECOND);
+}
+
+/* Streaming threads */
+static GstPadProbeReturn
+on_recq_in(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    (void)pad;
+    (void)info;
+    Session* session = user_data;
+    g_atomic_int_inc(&session->recq_in);
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+on_recq_out(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    (void)pad;
+    (void)info;
+    Session* session = user_data;
+    g_atomic_int_inc(&session->recq_out);
+    return GST_PAD_PROBE_OK;
+}
+
+/* Whatever went into recq and neither came out nor is still queued */
+static gint
+recording_leaked(Session* session)
+{
+    guint level = 0;
+    g_object_get(session->recq, "current-level-buffers", &level, NULL);
+    gint leaked = g_atomic_int_get(&session->recq_in) - g_atomic_int_get(&session->recq_out) - (gint)level;
+    return MAX(leaked, 0);
+}
+
+static void
+report_recording_leaks(Session* session, guint segment)
+{
+    gint leaked = recording_leaked(session);
+    gint dropped = leaked - session->recq_leaked_reported;
+
+    if (dropped > 0)
+        g_printerr("[receiver] '%s' recording segment %u is missing %d buffers, "
+            "dropped while the disk fell behind\n", session->id, segment, dropped);
+    session->recq_leaked_reported = MAX(leaked, session->recq_leaked_reported);
+}
+
+/* splitmuxsink's streaming thread, as a new file starts; NULL keeps "location" */
+static gchar*
+on_recording_segment(GstElement* rec, guint fragment_id, gpointer user_data)
+{
+    (void)rec;
+    Session* session = user_data;
+
+    if (fragment_id > 0)
+        report_recording_leaks(session, fragment_id - 1);
+    g_atomic_int_set(&session->recq_segment, (gint)fragment_id);
+    return NULL;
+}
+
+static void
+configure_recording(Session* session, GstElement* rxbin)
+{
+    GstElement* rec = gst_bin_get_by_name(GST_BIN(rxbin), "rec");
+    if (!rec)
+        return;
+
+    /* splitmuxsink printf()s the location with the fragment number */
+    gchar** parts = g_strsplit(record_dir, "%", -1);
+    gchar* dir = g_strjoinv("%%", parts);
+    g_strfreev(parts);
+    gchar* stem = session_file_stem(session);
+    gchar* location = g_strdup_printf("%s/%s-%%05d.%s", dir, stem,
+        g_strcmp0(record_format, "mkv") == 0 ? "mkv" : "mp4");
+    g_object_set(rec, "location", location, NULL);
+    g_free(location);
+    g_free(stem);
+    g_free(dir);
+
+    GstElement* mux;
+    if (g_strcmp0(record_format, "mkv") == 0) {
+        mux = gst_element_factory_make("matroskamux", NULL);
+        if (mux)
+            g_object_set(mux, "streamable", TRUE, NULL);
+    }
+    else {
+        mux = gst_element_factory_make("mp4mux", NULL);
+        if (mux)
+            g_object_set(mux, "fragment-duration", 1000, NULL);
+    }
+
+    if (mux)
+        g_object_set(rec, "muxer", mux, NULL);
+    else
+        g_printerr("[receiver] No %s muxer, recording with splitmuxsink's default\n", record_format);
+
+    session->recq = gst_bin_get_by_name(GST_BIN(rxbin), "recq");
+    if (session->recq) {
+        GstPad* pad = gst_element_get_static_pad(session->recq, "sink");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_recq_in, session, NULL);
+        gst_object_unref(pad);
+        pad = gst_element_get_static_pad(session->recq, "src");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_recq_out, session, NULL);
+        gst_object_unref(pad);
+        g_signal_connect(rec, "format-location", G_CALLBACK(on_recording_segment), session);
+    }
+
+    g_print("[receiver] Recording '%s' to %s in %ds segments\n",
+        session->id, record_dir, record_segment_s);
+    gst_object_unref(rec);
+}
+
+/* ---------- Loss recovery (--nack, --fec) ---------- */
+/* Transceivers come from the remote offer; set them up before the answer is made */
+static void
+on_new_transceiver(GstElement* webrtc, GstWebRTCRTPTransceiver* trans, gpointer user_data)
+{
+    (void)webrtc;
+    (void)user_data;
+
+    g_object_set(trans, "do-nack", nack, NULL);
+    if (fec)
+        g_object_set(trans, "fec-type", GST_WEBRTC_FEC_TYPE_ULP_RED, NULL);
+}
+
+/* ---------- Adaptive jitter buffer (--adaptive-jitter) ---------- */
+/*
+ * Once a second every session's inbound-rtp stats go through jitter.c; when
+ * it moves, the new latency goes to webrtcbin (which hands it to rtpbin's
+ * jitterbuffers) and the new depth to rxq.
+ */
+#define JITTER_INTERVAL_MS 1000
+
+typedef struct {
+    gchar* peer_id;
+    gdouble jitter;
+    guint64 packets_received;
+    gint64 packets_lost;
+    gint64 at_us;
+    gboolean found;
+} InboundReport;
+
+static void
+inbound_report_free(gpointer data)
+{
+    InboundReport* report = data;
+    g_free(report->peer_id);
+    g_free(report);
+}
+
+static gboolean
+find_inbound(GQuark field_id, const GValue* value, gpointer user_data)
+{
+    (void)field_id;
+    InboundReport* report = user_data;
+
+    if (!GST_VALUE_HOLDS_STRUCTURE(value))
+        return TRUE;
+
+    const GstStructure* stats = gst_value_get_structure(value);
+    GstWebRTCStatsType type;
+    if (!gst_structure_get(stats, "type", GST_TYPE_WEBRTC_STATS_TYPE, &type, NULL) ||
+        type != GST_WEBRTC_STATS_INBOUND_RTP)
+        return TRUE;
+
+    gst_structure_get_double(stats, "jitter", &report->jitter);
+    gst_structure_get_uint64(stats, "packets-received", &report->packets_received);
+    gst_structure_get_int64(stats, "packets-lost", &report->packets_lost);
+    report->found = TRUE;
+    return FALSE;
+}
+
+static gboolean
+apply_inbound_report(gpointer data)
+{
+    InboundReport* report = data;
+    Session* session = sessions ? g_hash_table_lookup(sessions, report->peer_id) : NULL;
+
+    if (!session || !session->webrtc)
+        return G_SOURCE_REMOVE;
+
+    guint latency_ms = session->jitter.latency_ms;
+    if (!jitter_tuner_on_report(&session->jitter, report->jitter,
+            report->packets_received, report->packets_lost, report->at_us))
+        return G_SOURCE_REMOVE;
+
+    if (session->jitter.latency_ms != latency_ms)
+        g_object_set(session->webrtc, "latency", session->jitter.latency_ms, NULL);
+    if (session->rxq)
+        g_object_set(session->rxq, "max-size-buffers", session->jitter.queue_buffers, NULL);
+
+    g_print("[receiver] '%s' jitter %.1f ms -> latency %u ms, rxq %u buffers\n", session->id,
+        session->jitter.jitter_ms, session->jitter.latency_ms, session->jitter.queue_buffers);
+    return G_SOURCE_REMOVE;
+}
+
+/* webrtcbin thread; user_data is the peer id */
+static void
+on_inbound_stats(GstPromise* promise, gpointer user_data)
+{
+    if (gst_promise_wait(promise) != GST_PROMISE_RESULT_REPLIED) {
+        gst_promise_unref(promise);
+        return;
+    }
+
+    InboundReport* report = g_new0(InboundReport, 1);
+    gst_structure_foreach(gst_promise_get_reply(promise), find_inbound, report);
+    report->peer_id = g_strdup(user_data);
+    report->at_us = g_get_monotonic_time();
+    gst_promise_unref(promise);
+
+    /* Nothing received yet */
+    if (!report->found) {
+        inbound_report_free(report);
+        return;
+    }
+
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT,
+        apply_inbound_report, report, inbound_report_free);
+}
+
+static gboolean
+on_jitter_tick(gpointer user_data)
+{
+    (void)user_data;
+
+    if (!sessions)
+        return G_SOURCE_CONTINUE;
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, sessions);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        Session* session = value;
+        if (!session->video_chain_built)
+            continue;
+
+        GstPromise* p = gst_promise_new_with_change_func(on_inbound_stats, g_strdup(session->id), g_free);
+        g_signal_emit_by_name(session->webrtc, "get-stats", NULL, p);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
 /* ---------- Media handling: explicit H.264 RTP -> depay -> parse -> decode -> display ---------- */
 
 
 
 /*Треба віддебажити*/
 static void
-on_incoming_stream(GstElement* webrtc, GstPad* pad, GstElement* pipep)
+on_incoming_stream(GstElement* webrtc, GstPad* pad, Session* session)
 {
     (void)webrtc;
 
@@ -84,7 +767,7 @@ on_incoming_stream(GstElement* webrtc, GstPad* pad, GstElement* pipep)
         return;
 
     /* Щоб не створювати кілька decode/display chain */
-    if (video_chain_built) {
+    if (session->video_chain_built) {
         g_print("[receiver] Video chain already built, ignoring extra pad\n");
         return;
     }
@@ -114,17 +797,21 @@ on_incoming_stream(GstElement* webrtc, GstPad* pad, GstElement* pipep)
     GError* err = NULL;
     //треба міняти max-size-buffers=значення щоб не було піксельного, але водночас не перебільшувати хоча якщо навіть 100 то не завжи погано
     /* Група (bin) з усіх модулів */
-    GstElement* rxbin = gst_parse_bin_from_description(
+    gchar* sink = describe_sink();
+    gchar* recording = record_dir ? describe_recording() : NULL;
+    gchar* desc = g_strdup_printf(
         "queue name=rxq "
         "max-size-buffers=10 max-size-bytes=0 max-size-time=0 leaky=downstream ! "
         "rtph264depay name=depay ! "
         "h264parse name=parse config-interval=1 ! "
-        "avdec_h264 name=dec ! "
-        "videoconvert name=conv ! "
-        "autovideosink name=vsink sync=false",
-        TRUE,
-        &err
-    );
+        "%s%s %s",
+        recording ? "tee name=rectee ! " : "",
+        sink,
+        recording ? recording : "");
+    g_free(sink);
+    g_free(recording);
+    GstElement* rxbin = gst_parse_bin_from_description(desc, TRUE, &err);
+    g_free(desc);
 
     if (err) {
         g_printerr("[receiver] Failed to create H264 bin: %s\n", err->message);
@@ -146,12 +833,51 @@ on_incoming_stream(GstElement* webrtc, GstPad* pad, GstElement* pipep)
             g_object_set(depay, "request-keyframe", TRUE, NULL);
         }
         if (g_object_class_find_property(G_OBJECT_GET_CLASS(depay), "wait-for-keyframe")) {
-            /* FALSE = менше фризів, але після втрати можуть бути артефакти */
-            g_object_set(depay, "wait-for-keyframe", FALSE, NULL);
+            /* FALSE = менше фризів, але після втрати можуть бути артефакти.
+             * With --nack little loss gets this far, and what does is answered
+             * by the keyframe request-keyframe asks for. */
+            g_object_set(depay, "wait-for-keyframe", nack, NULL);
         }
         gst_object_unref(depay);
     }
 
+    /* Without a decoder the first parsed access unit stands in for the first frame */
+    GstElement* dec = gst_bin_get_by_name(GST_BIN(rxbin), "dec");
+    GstElement* last = dec ? gst_object_ref(dec) : gst_bin_get_by_name(GST_BIN(rxbin), "parse");
+    if (last) {
+        GstPad* lastsrc = gst_element_get_static_pad(last, "src");
+        gst_pad_add_probe(lastsrc, GST_PAD_PROBE_TYPE_BUFFER, on_first_frame, session, NULL);
+        gst_object_unref(lastsrc);
+        gst_object_unref(last);
+    }
+
+    if (dec) {
+        GstPad* decsink = gst_element_get_static_pad(dec, "sink");
+        gst_pad_add_probe(decsink, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, on_decoder_caps, session, NULL);
+        gst_object_unref(decsink);
+        gst_object_unref(dec);
+    }
+
+    if (measure_latency)
+        add_latency_probes(session, rxbin);
+
+    if (record_dir)
+        configure_recording(session, rxbin);
+
+    if (adaptive_jitter) {
+        session->rxq = gst_bin_get_by_name(GST_BIN(rxbin), "rxq");
+        if (session->rxq)
+            g_object_set(session->rxq, "max-size-buffers", session->jitter.queue_buffers, NULL);
+    }
+
+    GstElement* conv = gst_bin_get_by_name(GST_BIN(rxbin), "conv");
+    if (conv) {
+        gchar* prefix = g_strdup_printf("[receiver] '%s'", session->id);
+        convert_report_first_buffer(conv, prefix);
+        g_free(prefix);
+        gst_object_unref(conv);
+    }
+
     /* Можна ще окремо докрутити sink (якщо захочеш qos=false / max-lateness) */
     GstElement* vsink = gst_bin_get_by_name(GST_BIN(rxbin), "vsink");
     if (vsink) {
@@ -161,10 +887,19 @@ on_incoming_stream(GstElement* webrtc, GstPad* pad, GstElement* pipep)
         if (g_object_class_find_property(G_OBJECT_GET_CLASS(vsink), "max-lateness")) {
             g_object_set(vsink, "max-lateness", (gint64)0, NULL);
         }
+        if (g_strcmp0(sink_name, "appsink") == 0)
+            g_signal_connect(vsink, "new-sample", G_CALLBACK(on_analytics_sample), session);
+        if (g_strcmp0(sink_name, "shm") == 0) {
+            gchar* stem = session_file_stem(session);
+            gchar* socket_path = g_strdup_printf("%s-%s.sock", sink_path, stem);
+            g_object_set(vsink, "socket-path", socket_path, NULL);
+            g_free(socket_path);
+            g_free(stem);
+        }
         gst_object_unref(vsink);
     }
 
-    gst_bin_add(GST_BIN(pipep), rxbin);
+    gst_bin_add(GST_BIN(session->pipep), rxbin);
     gst_element_sync_state_with_parent(rxbin);
 
     /* У rxbin буде ghost sink pad (бо TRUE в gst_parse_bin_from_description) */
@@ -182,98 +917,577 @@ on_incoming_stream(GstElement* webrtc, GstPad* pad, GstElement* pipep)
         g_printerr("[receiver] Failed to link webrtc pad -> rxbin (ret=%d)\n", ret);
     }
     else {
-        video_chain_built = TRUE;
-        g_print("[receiver] H264 receiver bin linked\n");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, on_first_rtp, session, NULL);
+        session->video_chain_built = TRUE;
+        g_print("[receiver] H264 receiver bin linked for '%s'\n", session->id);
     }
 
     gst_caps_unref(caps);
 }
 
-/* ---------- Signaling: send ICE ---------- */
+/* ---------- Signaling: framing ---------- */
+static gboolean
+conn_is_binary(SoupWebsocketConnection* conn)
+{
+    return g_strcmp0(soup_websocket_connection_get_protocol(conn), SIGNALING_PROTOCOL_BINARY) == 0;
+}
+
+static gboolean
+conn_is_deflated(SoupWebsocketConnection* conn)
+{
+    for (GList* l = soup_websocket_connection_get_extensions(conn); l; l = l->next) {
+        if (SOUP_IS_WEBSOCKET_EXTENSION_DEFLATE(l->data))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Frames are written for the connection the queue sends on. Until one is
+ * open that is JSON, which every end parses whatever the subprotocol. */
+static gboolean
+tx_binary(void)
+{
+    return tx_queue.conn && conn_is_binary(tx_queue.conn);
+}
+
+/* tx_text holds a frame written by signaling_write_*() in tx_binary()'s format */
 static void
-send_ice_candidate(GstElement* webrtcbin, guint mlineindex, gchar* candidate, gpointer user_data)
+send_tx_frame(Session* session, SignalingPriority priority, gboolean binary)
+{
+    signaling_queue_push(&tx_queue, priority, session->id, binary, tx_text->str, tx_text->len);
+}
+
+/* tx_queue handed a frame to libsoup, which deflates inside the send call:
+ * that is the per-frame CPU cost, credited to the peer the frame is for */
+static void
+on_frame_sent(const gchar* peer, gsize len, gint64 send_us, gpointer user_data)
 {
-    (void)webrtcbin;
     (void)user_data;
+    Session* session = sessions && peer ? g_hash_table_lookup(sessions, peer) : NULL;
 
-    if (!ws_conn || soup_websocket_connection_get_state(ws_conn) != SOUP_WEBSOCKET_STATE_OPEN)
+    if (!session)
         return;
+    session->stats.send_us += send_us;
+    session->stats.bytes_sent += len;
+}
 
-    JsonObject* ice = json_object_new();
-    json_object_set_string_member(ice, "candidate", candidate);
-    json_object_set_int_member(ice, "sdpMLineIndex", (gint)mlineindex);
+/* ---------- Signaling: send ICE ---------- */
+static void
+flush_ice_batch(Session* session)
+{
+    g_clear_handle_id(&session->ice_batch_source, g_source_remove);
+
+    if (session->ice_batch_count == 0)
+        return;
 
-    JsonObject* msg = json_object_new();
-    json_object_set_object_member(msg, "ice", ice);
+    gboolean binary = session->ice_batch_binary;
+    if (binary)
+        signaling_write_ice_batch_binary(tx_text, session->id, session->ice_batch);
+    else
+        signaling_write_ice_batch(tx_text, session->id, session->ice_batch, session->ice_batch_count);
+    send_tx_frame(session, SIGNALING_PRIORITY_ICE, binary);
+    session->stats.ice_sent += session->ice_batch_count;
+    session->stats.ice_frames_sent++;
+
+    g_string_truncate(session->ice_batch, 0);
+    session->ice_batch_count = 0;
+}
 
-    gchar* text = json_object_to_string(msg);
-    json_object_unref(msg);
+static gboolean
+on_ice_batch_timeout(gpointer user_data)
+{
+    Session* session = user_data;
 
-    soup_websocket_connection_send_text(ws_conn, text);
-    g_free(text);
+    session->ice_batch_source = 0;
+    flush_ice_batch(session);
+    return G_SOURCE_REMOVE;
 }
 
-/* ---------- Signaling: send SDP ---------- */
 static void
-send_sdp(GstWebRTCSessionDescription* desc)
+send_ice_candidate(Session* session, guint mlineindex, const gchar* candidate)
 {
-    if (!ws_conn || soup_websocket_connection_get_state(ws_conn) != SOUP_WEBSOCKET_STATE_OPEN)
+    if (ice_batch_ms <= 0) {
+        gboolean binary = tx_binary();
+        if (binary)
+            signaling_write_ice_binary(tx_text, session->id, mlineindex, candidate);
+        else
+            signaling_write_ice(tx_text, session->id, mlineindex, candidate);
+        send_tx_frame(session, SIGNALING_PRIORITY_ICE, binary);
+        session->stats.ice_sent++;
+        session->stats.ice_frames_sent++;
         return;
+    }
 
-    gchar* sdp_text = gst_sdp_message_as_text(desc->sdp);
+    if (!session->ice_batch)
+        session->ice_batch = g_string_sized_new(1024);
+    /* A batch keeps the format it was started in, even across a reconnect */
+    if (session->ice_batch_count == 0)
+        session->ice_batch_binary = tx_binary();
+    if (session->ice_batch_binary) {
+        signaling_append_ice_binary(session->ice_batch, mlineindex, candidate);
+    }
+    else {
+        if (session->ice_batch_count > 0)
+            g_string_append_c(session->ice_batch, ',');
+        signaling_append_ice(session->ice_batch, mlineindex, candidate);
+    }
+    session->ice_batch_count++;
 
-    JsonObject* sdp = json_object_new();
-    json_object_set_string_member(sdp, "type",
-        desc->type == GST_WEBRTC_SDP_TYPE_OFFER ? "offer" : "answer");
-    json_object_set_string_member(sdp, "sdp", sdp_text);
+    /* The window opens with the first candidate; a full batch goes out at once */
+    if (session->ice_batch_count >= SIGNALING_ICE_BATCH_MAX)
+        flush_ice_batch(session);
+    else if (!session->ice_batch_source)
+        session->ice_batch_source = g_timeout_add((guint)ice_batch_ms, on_ice_batch_timeout, session);
+}
 
-    JsonObject* msg = json_object_new();
-    json_object_set_object_member(msg, "sdp", sdp);
+/* ---------- Signaling: send SDP ---------- */
+static void
+send_sdp(Session* session, GstWebRTCSessionDescription* desc)
+{
+    /* Batched candidates are queued too; the description still goes first */
+    flush_ice_batch(session);
 
-    gchar* text = json_object_to_string(msg);
-    json_object_unref(msg);
+    gchar* sdp_text = gst_sdp_message_as_text(desc->sdp);
+    const gchar* sdp_type = desc->type == GST_WEBRTC_SDP_TYPE_OFFER ? "offer" : "answer";
+    gboolean binary = tx_binary();
 
-    soup_websocket_connection_send_text(ws_conn, text);
+    if (binary)
+        signaling_write_sdp_binary(tx_text, session->id, sdp_type, sdp_text);
+    else
+        signaling_write_sdp(tx_text, session->id, sdp_type, sdp_text);
+    send_tx_frame(session, SIGNALING_PRIORITY_SDP, binary);
 
-    g_free(text);
     g_free(sdp_text);
+    session->stats.sdp_sent++;
+    timeline_mark(&session->timeline,
+        desc->type == GST_WEBRTC_SDP_TYPE_OFFER ? TIMELINE_OFFER_SENT : TIMELINE_ANSWER_SENT);
+}
+
+/* ---------- Signaling: hop from webrtcbin threads to the main loop ---------- */
+/*
+ * webrtcbin emits on-ice-candidate and replies to promises from its own
+ * threads. The websocket and the session table belong to the main loop, so
+ * outgoing messages are handed over by peer id; if the session is gone by the
+ * time the main loop runs, the message is dropped.
+ */
+typedef struct {
+    gchar* peer_id;
+    GstWebRTCSessionDescription* desc; /* NULL for an ICE candidate */
+    guint mlineindex;
+    gchar* candidate;
+} OutboundMessage;
+
+static void
+outbound_message_free(gpointer data)
+{
+    OutboundMessage* out = data;
+    g_free(out->peer_id);
+    if (out->desc)
+        gst_webrtc_session_description_free(out->desc);
+    g_free(out->candidate);
+    g_free(out);
+}
+
+static gboolean
+send_outbound_message(gpointer data)
+{
+    OutboundMessage* out = data;
+    Session* session = sessions ? g_hash_table_lookup(sessions, out->peer_id) : NULL;
+
+    if (!session)
+        return G_SOURCE_REMOVE;
+
+    if (out->desc) {
+        GstPromise* p = gst_promise_new();
+        g_signal_emit_by_name(session->webrtc, "set-local-description", out->desc, p);
+        gst_promise_interrupt(p);
+        gst_promise_unref(p);
+
+        g_print("[receiver] Sending SDP answer to '%s'\n", session->id);
+        send_sdp(session, out->desc);
+        session->state = NEGOTIATION_STABLE;
+    }
+    else
+        send_ice_candidate(session, out->mlineindex, out->candidate);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+queue_outbound_message(OutboundMessage* out)
+{
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT,
+        send_outbound_message, out, outbound_message_free);
+}
+
+static void
+on_ice_candidate(GstElement* webrtcbin, guint mlineindex, gchar* candidate, gpointer user_data)
+{
+    (void)webrtcbin;
+    Session* session = user_data;
+
+    timeline_mark(&session->timeline, TIMELINE_FIRST_LOCAL_ICE);
+
+    OutboundMessage* out = g_new0(OutboundMessage, 1);
+    out->peer_id = g_strdup(session->id);
+    out->mlineindex = mlineindex;
+    out->candidate = g_strdup(candidate);
+    queue_outbound_message(out);
 }
 
 /* ---------- Answer created callback ---------- */
+/* webrtcbin thread; user_data is the peer id. The session may be gone by the
+ * time the answer is ready, so it is only looked up again on the main loop. */
 static void
 on_answer_created(GstPromise* promise, gpointer user_data)
 {
-    (void)user_data;
-
+    const gchar* peer_id = user_data;
     const GstStructure* reply = NULL;
     GstWebRTCSessionDescription* answer = NULL;
+    GError* error = NULL;
 
-    g_assert(gst_promise_wait(promise) == GST_PROMISE_RESULT_REPLIED);
+    /* Interrupted when the session is torn down mid-negotiation */
+    if (gst_promise_wait(promise) != GST_PROMISE_RESULT_REPLIED) {
+        gst_promise_unref(promise);
+        return;
+    }
     reply = gst_promise_get_reply(promise);
-    gst_structure_get(reply, "answer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &answer, NULL);
+    if (reply && gst_structure_get(reply, "error", G_TYPE_ERROR, &error, NULL)) {
+        g_printerr("[receiver] create-answer for '%s' failed: %s\n", peer_id, error->message);
+        g_error_free(error);
+        gst_promise_unref(promise);
+        return;
+    }
+    if (reply)
+        gst_structure_get(reply, "answer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &answer, NULL);
     gst_promise_unref(promise);
 
-    /* Set local description */
-    GstPromise* p = gst_promise_new();
-    g_signal_emit_by_name(webrtc, "set-local-description", answer, p);
-    gst_promise_interrupt(p);
-    gst_promise_unref(p);
+    if (!answer) {
+        g_printerr("[receiver] create-answer for '%s' returned no answer\n", peer_id);
+        return;
+    }
+
+    /* Set as local description and sent to the peer on the main loop */
+    OutboundMessage* out = g_new0(OutboundMessage, 1);
+    out->peer_id = g_strdup(peer_id);
+    out->desc = answer;
+    queue_outbound_message(out);
+}
+
+/* Main loop; data is the peer id whose offer has been applied */
+static gboolean
+create_answer(gpointer data)
+{
+    const gchar* peer_id = data;
+    Session* session = sessions ? g_hash_table_lookup(sessions, peer_id) : NULL;
 
-    /* Send to peer */
-    g_print("[receiver] Sending SDP answer\n");
-    send_sdp(answer);
+    if (!session || session->state != NEGOTIATION_OFFER_RECEIVED)
+        return G_SOURCE_REMOVE;
 
-    gst_webrtc_session_description_free(answer);
+    GstPromise* p = gst_promise_new_with_change_func(on_answer_created,
+        g_strdup(session->id), g_free);
+    g_signal_emit_by_name(session->webrtc, "create-answer", NULL, p);
+    return G_SOURCE_REMOVE;
 }
 
+/* webrtcbin thread; user_data is the peer id */
 static void
 on_offer_set(GstPromise* promise, gpointer user_data)
 {
-    (void)user_data;
+    const gchar* peer_id = user_data;
+    const GstStructure* reply = NULL;
+    GError* error = NULL;
+
+    if (gst_promise_wait(promise) != GST_PROMISE_RESULT_REPLIED) {
+        gst_promise_unref(promise);
+        return;
+    }
+    reply = gst_promise_get_reply(promise);
+    if (reply && gst_structure_get(reply, "error", G_TYPE_ERROR, &error, NULL)) {
+        g_printerr("[receiver] set-remote-description for '%s' failed: %s\n",
+            peer_id, error->message);
+        g_error_free(error);
+        gst_promise_unref(promise);
+        return;
+    }
     gst_promise_unref(promise);
 
-    GstPromise* p = gst_promise_new_with_change_func(on_answer_created, NULL, NULL);
-    g_signal_emit_by_name(webrtc, "create-answer", NULL, p);
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT,
+        create_answer, g_strdup(peer_id), g_free);
+}
+
+/* ---------- Sessions: one pipeline + webrtcbin per remote peer ---------- */
+static void
+pending_ice_free(gpointer data)
+{
+    PendingIce* ice = data;
+    g_free(ice->candidate);
+    g_free(ice);
+}
+
+static void
+session_add_remote_ice(Session* session, guint mlineindex, const gchar* candidate)
+{
+    session->stats.ice_received++;
+    timeline_mark(&session->timeline, TIMELINE_FIRST_REMOTE_ICE);
+
+    if (session->state == NEGOTIATION_NEW) {
+        PendingIce* ice = g_new0(PendingIce, 1);
+        ice->mlineindex = mlineindex;
+        ice->candidate = g_strdup(candidate);
+        g_queue_push_tail(&session->pending_ice, ice);
+        return;
+    }
+
+    g_signal_emit_by_name(session->webrtc, "add-ice-candidate", mlineindex, candidate);
+}
+
+/* ---------- Early ICE: candidates that overtake the offer ---------- */
+/*
+ * Only an offer creates a session. Candidates for a peer without one are
+ * held here, for a few peers and a few candidates each, until the offer
+ * arrives or EARLY_ICE_TTL_US passes. The rest, including late candidates
+ * from a peer that already left, are dropped.
+ */
+#define EARLY_ICE_MAX_PEERS 16
+#define EARLY_ICE_MAX_CANDIDATES 64
+#define EARLY_ICE_TTL_US (10 * G_USEC_PER_SEC)
+
+typedef struct {
+    GQueue candidates;  /* PendingIce* */
+    gint64 first_us;
+} EarlyIce;
+
+static void
+early_ice_free(gpointer data)
+{
+    EarlyIce* early = data;
+    g_queue_clear_full(&early->candidates, pending_ice_free);
+    g_free(early);
+}
+
+static gboolean
+early_ice_expired(gpointer key, gpointer value, gpointer user_data)
+{
+    (void)key;
+    EarlyIce* early = value;
+    return *(gint64*)user_data - early->first_us > EARLY_ICE_TTL_US;
+}
+
+static void
+early_ice_add(const gchar* peer_id, guint mlineindex, const gchar* candidate)
+{
+    gint64 now_us = g_get_monotonic_time();
+    g_hash_table_foreach_remove(early_ice, early_ice_expired, &now_us);
+
+    EarlyIce* early = g_hash_table_lookup(early_ice, peer_id);
+    if (!early) {
+        if (g_hash_table_size(early_ice) >= EARLY_ICE_MAX_PEERS)
+            return;
+        early = g_new0(EarlyIce, 1);
+        g_queue_init(&early->candidates);
+        early->first_us = now_us;
+        g_hash_table_insert(early_ice, g_strdup(peer_id), early);
+    }
+    if (early->candidates.length >= EARLY_ICE_MAX_CANDIDATES)
+        return;
+
+    PendingIce* ice = g_new0(PendingIce, 1);
+    ice->mlineindex = mlineindex;
+    ice->candidate = g_strdup(candidate);
+    g_queue_push_tail(&early->candidates, ice);
+}
+
+/* A new session takes over what its peer sent ahead of the offer */
+static void
+early_ice_claim(Session* session)
+{
+    EarlyIce* early = g_hash_table_lookup(early_ice, session->id);
+    if (!early)
+        return;
+
+    timeline_mark_at(&session->timeline, TIMELINE_FIRST_REMOTE_ICE, early->first_us);
+    session->stats.ice_received += early->candidates.length;
+    PendingIce* ice;
+    while ((ice = g_queue_pop_head(&early->candidates)))
+        g_queue_push_tail(&session->pending_ice, ice);
+    g_hash_table_remove(early_ice, session->id);
+}
+
+static void
+session_flush_pending_ice(Session* session)
+{
+    PendingIce* ice;
+    while ((ice = g_queue_pop_head(&session->pending_ice))) {
+        g_signal_emit_by_name(session->webrtc, "add-ice-candidate", ice->mlineindex, ice->candidate);
+        pending_ice_free(ice);
+    }
+}
+
+static void
+session_free(gpointer data)
+{
+    Session* session = data;
+
+    /* Whatever was reached, for sessions that never showed a frame */
+    report_timeline(session);
+
+    g_print("[receiver] Session '%s' closed after %.1fs (sdp tx/rx %u/%u, ice tx/rx %u/%u)\n",
+        session->id,
+        (g_get_monotonic_time() - session->stats.created_us) / (gdouble)G_USEC_PER_SEC,
+        session->stats.sdp_sent, session->stats.sdp_received,
+        session->stats.ice_sent, session->stats.ice_received);
+    if (session->stats.ice_frames_sent != session->stats.ice_sent)
+        g_print("[receiver] Session '%s' sent %u local candidates in %u frames\n",
+            session->id, session->stats.ice_sent, session->stats.ice_frames_sent);
+    g_print("[receiver] Session '%s' signaling %" G_GSIZE_FORMAT "/%" G_GSIZE_FORMAT
+        " payload bytes tx/rx, %.2f ms in send (%s)\n",
+        session->id, session->stats.bytes_sent, session->stats.bytes_received,
+        session->stats.send_us / 1000.0, ws_deflate ? "permessage-deflate" : "uncompressed");
+
+    /* The last segment has no successor to report it; before NULL flushes
+     * recq, which would count what it still holds as dropped */
+    if (session->recq) {
+        GstElement* rec = gst_bin_get_by_name(GST_BIN(session->pipep), "rec");
+        if (rec) {
+            g_signal_handlers_disconnect_by_data(rec, session);
+            gst_object_unref(rec);
+        }
+        report_recording_leaks(session, (guint)g_atomic_int_get(&session->recq_segment));
+    }
+
+    if (session->pipep) {
+        if (session->webrtc)
+            g_signal_handlers_disconnect_by_data(session->webrtc, session);
+        gst_element_set_state(session->pipep, GST_STATE_NULL);
+        g_clear_object(&session->pipep);
+        session->webrtc = NULL;
+    }
+
+    gst_clear_object(&session->rxq);
+    gst_clear_object(&session->recq);
+
+    if (session->frames_delivered)
+        g_print("[receiver] Session '%s' delivered %d frames to appsink\n",
+            session->id, session->frames_delivered);
+
+    if (session->decoder_threads) {
+        g_mutex_lock(&decoder_budget_lock);
+        decoder_threads_used -= session->decoder_threads;
+        g_mutex_unlock(&decoder_budget_lock);
+    }
+
+    /* Streaming has stopped, so the stats are ours now */
+    if (session->latency) {
+        g_print("[receiver] latency '%s' %s\n", session->id,
+            latency_stats_write_json(session->latency, session->latency_text));
+        latency_stats_free(session->latency);
+        latency_stamp_map_free(session->capture_times);
+        g_string_free(session->latency_text, TRUE);
+    }
+
+    g_clear_handle_id(&session->ice_batch_source, g_source_remove);
+    if (session->ice_batch)
+        g_string_free(session->ice_batch, TRUE);
+    g_queue_clear_full(&session->pending_ice, pending_ice_free);
+    g_free(session->id);
+    g_free(session);
+}
+
+static Session*
+add_session(const gchar* peer_id)
+{
+    Session* session = g_new0(Session, 1);
+    session->id = g_strdup(peer_id);
+    session->stats.created_us = g_get_monotonic_time();
+    timeline_init(&session->timeline);
+    timeline_mark_at(&session->timeline, TIMELINE_WS_CONNECTED, ws_connected_us);
+    timeline_mark_at(&session->timeline, TIMELINE_SESSION_CREATED, session->stats.created_us);
+    g_queue_init(&session->pending_ice);
+
+    gchar* name = g_strdup_printf("receiver-%s", peer_id[0] ? peer_id : "default");
+    session->pipep = gst_pipeline_new(name);
+    g_free(name);
+    session->webrtc = gst_element_factory_make("webrtcbin", "sendrecv");
+
+    if (!session->pipep || !session->webrtc) {
+        g_printerr("[receiver] Failed to create pipepline or webrtcbin for '%s'\n", peer_id);
+        gst_clear_object(&session->webrtc);
+        session_free(session);
+        return NULL;
+    }
+
+    /* Match your previous parse-launch property */
+    g_object_set(session->webrtc, "bundle-policy", GST_WEBRTC_BUNDLE_POLICY_MAX_BUNDLE, NULL);
+
+    if (adaptive_jitter) {
+        jitter_tuner_init(&session->jitter, (guint)jitter_min_ms, (guint)jitter_max_ms,
+            (guint)queue_min_buffers, (guint)queue_max_buffers);
+        g_object_set(session->webrtc, "latency", session->jitter.latency_ms, NULL);
+    }
+
+    gst_bin_add(GST_BIN(session->pipep), session->webrtc);
+
+    g_signal_connect(session->webrtc, "on-ice-candidate", G_CALLBACK(on_ice_candidate), session);
+    g_signal_connect(session->webrtc, "pad-added", G_CALLBACK(on_incoming_stream), session);
+    if (nack || fec)
+        g_signal_connect(session->webrtc, "on-new-transceiver", G_CALLBACK(on_new_transceiver), session);
+    g_signal_connect(session->webrtc, "notify::ice-connection-state", G_CALLBACK(on_ice_connection_state), session);
+    g_signal_connect(session->webrtc, "notify::connection-state", G_CALLBACK(on_connection_state), session);
+
+    g_hash_table_insert(sessions, session->id, session);
+
+    GstStateChangeReturn sret = gst_element_set_state(session->pipep, GST_STATE_PLAYING);
+    if (sret == GST_STATE_CHANGE_FAILURE) {
+        g_printerr("[receiver] Failed to set pipepline to PLAYING for '%s'\n", peer_id);
+        g_hash_table_remove(sessions, peer_id);
+        return NULL;
+    }
+
+    g_print("[receiver] Session '%s' added (%u active)\n", peer_id, g_hash_table_size(sessions));
+    return session;
+}
+
+static Session*
+lookup_or_add_session(const gchar* peer_id)
+{
+    Session* session = g_hash_table_lookup(sessions, peer_id);
+    if (!session && (session = add_session(peer_id)))
+        early_ice_claim(session);
+    return session;
+}
+
+static void
+remove_session(const gchar* peer_id)
+{
+    g_hash_table_remove(early_ice, peer_id);
+    if (g_hash_table_remove(sessions, peer_id)) {
+        /* Whatever it still had queued is for a peer connection that is gone */
+        signaling_queue_drop_peer(&tx_queue, peer_id);
+        g_print("[receiver] Session '%s' removed (%u active)\n", peer_id, g_hash_table_size(sessions));
+    }
+}
+
+/*
+ * The relay announces a leave when the peer's signaling drops, and a peer
+ * that comes back gets a new id. Media that is still connected is kept
+ * until the peer connection ends (reap_left_session()); only sessions
+ * without live media go right away.
+ */
+static void
+leave_session(const gchar* peer_id)
+{
+    Session* session = g_hash_table_lookup(sessions, peer_id);
+    GstWebRTCPeerConnectionState state = GST_WEBRTC_PEER_CONNECTION_STATE_CLOSED;
+    if (session)
+        g_object_get(session->webrtc, "connection-state", &state, NULL);
+    if (state != GST_WEBRTC_PEER_CONNECTION_STATE_CONNECTED) {
+        remove_session(peer_id);
+        return;
+    }
+
+    session->peer_left = TRUE;
+    g_print("[receiver] '%s' left signaling, keeping its media until the connection ends\n", peer_id);
 }
 
 /* ---------- Receive signaling messages (offer + ICE) ---------- */
@@ -284,97 +1498,156 @@ handle_server_message(SoupWebsocketConnection* conn, SoupWebsocketDataType type,
     (void)conn;
     (void)user_data;
 
-    if (type != SOUP_WEBSOCKET_DATA_TEXT)
-        return;
-
     gsize size = 0;
     const gchar* data = g_bytes_get_data(message, &size);
-    gchar* text = g_strndup(data, size);
 
-    JsonParser* parser = json_parser_new();
-    if (!json_parser_load_from_data(parser, text, -1, NULL)) {
-        g_object_unref(parser);
-        g_free(text);
-        return;
+    /* Both forms are parsed in place; parser is only set for the json-glib fallback */
+    SignalingMessage msg;
+    JsonParser* parser = NULL;
+    if (type == SOUP_WEBSOCKET_DATA_BINARY) {
+        if (!signaling_parse_binary(data, size, &msg))
+            return;
     }
-
-    JsonNode* root = json_parser_get_root(parser);
-    if (!JSON_NODE_HOLDS_OBJECT(root)) {
-        g_object_unref(parser);
-        g_free(text);
+    else if (!signaling_parse_text(data, size, &msg, &parser)) {
         return;
     }
 
-    JsonObject* obj = json_node_get_object(root);
+    const gchar* peer_id = signaling_span_str(&msg.peer, rx_peer);
+
+    if (msg.type == SIGNALING_MSG_LEAVE) {
+        leave_session(peer_id);
+    }
+    else if (msg.type == SIGNALING_MSG_SDP) {
+        Session* session = NULL;
+        if (signaling_span_equal(&msg.sdp_type, "offer")) {
+            /* Offered again after answering: the sender rebuilt its end
+             * (new ICE agent and DTLS), so this end starts over too */
+            Session* answered = g_hash_table_lookup(sessions, peer_id);
+            if (answered && answered->state != NEGOTIATION_NEW)
+                remove_session(peer_id);
+            session = lookup_or_add_session(peer_id);
+        }
 
-    if (json_object_has_member(obj, "sdp")) {
-        JsonObject* sdpobj = json_object_get_object_member(obj, "sdp");
-        const gchar* sdptype = json_object_get_string_member(sdpobj, "type");
-        const gchar* sdptext = json_object_get_string_member(sdpobj, "sdp");
+        if (session) {
+            session->stats.bytes_received += size;
+            const gchar* sdptext = signaling_span_str(&msg.sdp, rx_text);
 
-        if (g_strcmp0(sdptype, "offer") == 0) {
             GstSDPMessage* sdp = NULL;
             gst_sdp_message_new(&sdp);
-            gst_sdp_message_parse_buffer((guint8*)sdptext, (guint)strlen(sdptext), sdp);
+            gst_sdp_message_parse_buffer((guint8*)sdptext, (guint)rx_text->len, sdp);
 
             GstWebRTCSessionDescription* offer =
                 gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_OFFER, sdp);
 
-            g_print("[receiver] Received SDP offer -> set-remote-description\n");
-            GstPromise* p = gst_promise_new_with_change_func(on_offer_set, NULL, NULL);
-            g_signal_emit_by_name(webrtc, "set-remote-description", offer, p);
+            g_print("[receiver] Received SDP offer from '%s' -> set-remote-description\n", session->id);
+            GstPromise* p = gst_promise_new_with_change_func(on_offer_set,
+                g_strdup(session->id), g_free);
+            g_signal_emit_by_name(session->webrtc, "set-remote-description", offer, p);
 
             gst_webrtc_session_description_free(offer);
+
+            /* webrtcbin runs its operations in order, so candidates queued
+             * behind set-remote-description see the offer applied */
+            session->stats.sdp_received++;
+            timeline_mark(&session->timeline, TIMELINE_OFFER_RECEIVED);
+            session->state = NEGOTIATION_OFFER_RECEIVED;
+            session_flush_pending_ice(session);
         }
     }
-    else if (json_object_has_member(obj, "ice")) {
-        JsonObject* ice = json_object_get_object_member(obj, "ice");
-        const gchar* candidate = json_object_get_string_member(ice, "candidate");
-        gint mline = json_object_get_int_member(ice, "sdpMLineIndex");
-        g_signal_emit_by_name(webrtc, "add-ice-candidate", mline, candidate);
+    else if (msg.type == SIGNALING_MSG_ICE) {
+        /* Candidates may overtake the offer through the relay; they never
+         * create a session themselves */
+        Session* session = g_hash_table_lookup(sessions, peer_id);
+        if (session)
+            session->stats.bytes_received += size;
+        for (guint i = 0; i < msg.n_ice; i++) {
+            const gchar* candidate = signaling_span_str(&msg.ice[i].candidate, rx_text);
+            if (session)
+                session_add_remote_ice(session, msg.ice[i].mlineindex, candidate);
+            else
+                early_ice_add(peer_id, msg.ice[i].mlineindex, candidate);
+        }
+        if (msg.n_ice_dropped)
+            g_printerr("[receiver] '%s' batched %u candidates past the limit of %d, dropped\n",
+                peer_id, msg.n_ice_dropped, SIGNALING_ICE_BATCH_MAX);
     }
 
-    g_object_unref(parser);
-    g_free(text);
+    g_clear_object(&parser);
 }
 
-/* ---------- Create receiver pipepline ---------- */
+/* ---------- WebSocket connect ---------- */
+static void connect_to_server_async(void);
+
 static gboolean
-start_pipeline(void)
+on_reconnect_timeout(gpointer user_data)
 {
-    pipep = gst_pipeline_new("receiver-pipepline");
-    webrtc = gst_element_factory_make("webrtcbin", "sendrecv");
-
-    if (!pipep || !webrtc) {
-        g_printerr("[receiver] Failed to create pipepline or webrtcbin\n");
-        return FALSE;
-    }
-
-    /* Match your previous parse-launch property */
-    g_object_set(webrtc, "bundle-policy", GST_WEBRTC_BUNDLE_POLICY_MAX_BUNDLE, NULL);
-
-    gst_bin_add(GST_BIN(pipep), webrtc);
+    (void)user_data;
+    reconnect_source = 0;
+    connect_to_server_async();
+    return G_SOURCE_REMOVE;
+}
 
-    g_signal_connect(webrtc, "on-ice-candidate", G_CALLBACK(send_ice_candidate), NULL);
-    g_signal_connect(webrtc, "pad-added", G_CALLBACK(on_incoming_stream), pipep);
+static void
+schedule_reconnect(void)
+{
+    guint delay_ms = backoff_next_ms(&reconnect_backoff);
+    g_print("[receiver] Reconnecting to signaling in %u ms (media keeps running)\n", delay_ms);
+    reconnect_source = g_timeout_add(delay_ms, on_reconnect_timeout, NULL);
+}
 
-    GstStateChangeReturn sret = gst_element_set_state(pipep, GST_STATE_PLAYING);
-    if (sret == GST_STATE_CHANGE_FAILURE) {
-        g_printerr("[receiver] Failed to set pipepline to PLAYING\n");
-        return FALSE;
+/*
+ * Back on signaling after an outage: live sessions move to the new
+ * connection. Failed ones, and ones whose offer/answer was cut off, are
+ * dropped; the sender's next offer builds them afresh.
+ */
+static void
+resume_sessions(void)
+{
+    GPtrArray* dead = g_ptr_array_new_with_free_func(g_free);
+    guint kept = 0;
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, sessions);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        Session* session = value;
+        GstWebRTCPeerConnectionState state;
+        g_object_get(session->webrtc, "connection-state", &state, NULL);
+
+        if (session->state == NEGOTIATION_STABLE &&
+            state != GST_WEBRTC_PEER_CONNECTION_STATE_FAILED &&
+            state != GST_WEBRTC_PEER_CONNECTION_STATE_CLOSED)
+            kept++;
+        else
+            g_ptr_array_add(dead, g_strdup(session->id));
     }
 
-    g_print("[receiver] pipeline started (waiting for offer)\n");
-    return TRUE;
+    for (guint i = 0; i < dead->len; i++)
+        remove_session(g_ptr_array_index(dead, i));
+
+    g_print("[receiver] Signaling resumed: %u sessions kept, %u dropped\n", kept, dead->len);
+    g_ptr_array_unref(dead);
 }
 
-/* ---------- WebSocket connect ---------- */
 static void
 on_server_closed(SoupWebsocketConnection* conn, gpointer user_data)
 {
-    (void)conn;
     (void)user_data;
-    cleanup_and_quit("[receiver] Server closed");
+
+    if (!reconnect || !loop) {
+        cleanup_and_quit("[receiver] Server closed");
+        return;
+    }
+
+    g_signal_handlers_disconnect_by_func(conn, handle_server_message, NULL);
+    g_signal_handlers_disconnect_by_func(conn, on_server_closed, NULL);
+    if (conn == ws_conn)
+        g_clear_object(&ws_conn);
+
+    /* Frames produced during the outage wait for the next connection */
+    signaling_queue_set_connection(&tx_queue, NULL);
+    g_print("[receiver] Signaling queue: %s\n", signaling_queue_write_report(&tx_queue, tx_text));
+    schedule_reconnect();
 }
 
 static void
@@ -387,16 +1660,31 @@ on_server_connected(SoupSession* session, GAsyncResult* res, SoupMessage* msg)
     if (error) {
         g_printerr("WS connect failed: %s\n", error->message);
         g_error_free(error);
-        cleanup_and_quit("[receiver] WS connect failed");
+        if (reconnect && sessions)
+            schedule_reconnect();
+        else
+            cleanup_and_quit("[receiver] WS connect failed");
         return;
     }
-
-    g_print("[receiver] Connected to signaling server\n");
+    ws_connected_us = g_get_monotonic_time();
+    ws_deflate = conn_is_deflated(ws_conn);
+    backoff_reset(&reconnect_backoff);
+
+    g_print("[receiver] Connected to signaling server, %s signaling%s (waiting for offers)\n",
+        conn_is_binary(ws_conn) ? "binary" : "JSON", ws_deflate ? " with permessage-deflate" : "");
+    if (compress_signaling && !ws_deflate)
+        g_print("[receiver] Server declined permessage-deflate, signaling is uncompressed\n");
+    if (sessions)
+        resume_sessions();
+    else
+        sessions = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, session_free);
+    if (!early_ice)
+        early_ice = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, early_ice_free);
     g_signal_connect(ws_conn, "message", G_CALLBACK(handle_server_message), NULL);
     g_signal_connect(ws_conn, "closed", G_CALLBACK(on_server_closed), NULL);
 
-    if (!start_pipeline())
-        cleanup_and_quit("[receiver] Failed to start pipeline");
+    /* Only now, so frames queued by sessions resume_sessions() dropped are gone */
+    signaling_queue_set_connection(&tx_queue, ws_conn);
 }
 
 
@@ -428,6 +1716,12 @@ connect_to_server_async(void)
     SoupSession* session = soup_session_new();
     SoupMessage* message = soup_message_new(SOUP_METHOD_GET, server_url);
 
+    /* libsoup offers permessage-deflate by default; keep it opt-in */
+    if (!compress_signaling)
+        soup_session_remove_feature_by_type(session, SOUP_TYPE_WEBSOCKET_EXTENSION_DEFLATE);
+    else if (!soup_session_has_feature(session, SOUP_TYPE_WEBSOCKET_EXTENSION_MANAGER))
+        soup_session_add_feature_by_type(session, SOUP_TYPE_WEBSOCKET_EXTENSION_MANAGER);
+
     if (!message) {
         cleanup_and_quit("[receiver] Failed to create SoupMessage");
         return;
@@ -440,11 +1734,13 @@ connect_to_server_async(void)
 
     g_print("[receiver] Connecting to %s ...\n", server_url);
 
+    static gchar* protocols[] = { SIGNALING_PROTOCOL_BINARY, SIGNALING_PROTOCOL_JSON, NULL };
+
     soup_session_websocket_connect_async(
         session,
         message,
         NULL,                    /* origin */
-        NULL,                    /* protocols */
+        binary_signaling ? protocols : NULL,
         G_PRIORITY_DEFAULT,      /* io_priority */
         NULL,                    /* cancellable */
         (GAsyncReadyCallback)on_server_connected,
@@ -456,6 +1752,27 @@ connect_to_server_async(void)
 static GOptionEntry entries[] = {
   {"server", 0, 0, G_OPTION_ARG_STRING, &server_url, "Signaling server URL (wss://...)", "URL"},
   {"disable-ssl", 0, 0, G_OPTION_ARG_NONE, &disable_ssl, "Disable TLS cert checks (useful for self-signed)", NULL},
+  {"ice-batch-ms", 0, 0, G_OPTION_ARG_INT, &ice_batch_ms, "Coalesce local ICE candidates gathered within MS into one message (0 = off)", "MS"},
+  {"binary-signaling", 0, 0, G_OPTION_ARG_NONE, &binary_signaling, "Offer the binary signaling subprotocol (falls back to JSON)", NULL},
+  {"compress-signaling", 0, 0, G_OPTION_ARG_NONE, &compress_signaling, "Offer permessage-deflate on the signaling connection", NULL},
+  {"decode-threads", 0, 0, G_OPTION_ARG_INT, &decode_threads, "avdec_h264 threads per stream (0 = by resolution)", "N"},
+  {"decode-threading", 0, 0, G_OPTION_ARG_STRING, &decode_threading, "slice (no added latency), frame (one frame per thread), or auto (libav decides)", "TYPE"},
+  {"decode-low-delay", 0, 0, G_OPTION_ARG_NONE, &decode_low_delay, "Slice threading only, so at most one frame is in the decoder (overrides --decode-threading)", NULL},
+  {"decoder-thread-budget", 0, 0, G_OPTION_ARG_INT, &decoder_thread_budget, "Decoder threads shared by all streams of this process (0 = one per core)", "N"},
+  {"sink", 0, 0, G_OPTION_ARG_STRING, &sink_name, "display, fake, appsink, shm, or none (stop after h264parse)", "SINK"},
+  {"sink-path", 0, 0, G_OPTION_ARG_STRING, &sink_path, "Socket path prefix for --sink=shm", "PATH"},
+  {"no-reconnect", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &reconnect, "Quit when the signaling connection drops instead of redialling", NULL},
+  {"nack", 0, 0, G_OPTION_ARG_NONE, &nack, "Request retransmissions (RTX) and wait for a keyframe after unrecovered loss", NULL},
+  {"fec", 0, 0, G_OPTION_ARG_NONE, &fec, "Accept ULPFEC/RED from the sender", NULL},
+  {"adaptive-jitter", 0, 0, G_OPTION_ARG_NONE, &adaptive_jitter, "Size the jitterbuffer and receive queue from measured jitter and loss", NULL},
+  {"jitter-min-latency", 0, 0, G_OPTION_ARG_INT, &jitter_min_ms, "Lowest jitterbuffer latency for --adaptive-jitter", "MS"},
+  {"jitter-max-latency", 0, 0, G_OPTION_ARG_INT, &jitter_max_ms, "Highest jitterbuffer latency for --adaptive-jitter", "MS"},
+  {"queue-min-buffers", 0, 0, G_OPTION_ARG_INT, &queue_min_buffers, "Smallest receive queue for --adaptive-jitter", "N"},
+  {"queue-max-buffers", 0, 0, G_OPTION_ARG_INT, &queue_max_buffers, "Largest receive queue for --adaptive-jitter", "N"},
+  {"record", 0, 0, G_OPTION_ARG_FILENAME, &record_dir, "Also write the received H.264 to DIR without decoding", "DIR"},
+  {"record-format", 0, 0, G_OPTION_ARG_STRING, &record_format, "mp4 (fragmented) or mkv", "FORMAT"},
+  {"record-segment", 0, 0, G_OPTION_ARG_INT, &record_segment_s, "Start a new recording file every N seconds", "N"},
+  {"measure-latency", 0, 0, G_OPTION_ARG_NONE, &measure_latency, "Report glass-to-glass latency percentiles from sender --stamp-frames", NULL},
   {NULL}
 };
 
@@ -473,8 +1790,58 @@ main(int argc, char* argv[])
         return 1;
     }
 
+    if (!g_strv_contains((const gchar* const[]) { "display", "fake", "appsink", "shm", "none", NULL }, sink_name)) {
+        g_printerr("Unknown --sink '%s' (display, fake, appsink, shm, none)\n", sink_name);
+        return 1;
+    }
+
+    if (adaptive_jitter && (jitter_min_ms <= 0 || jitter_max_ms < jitter_min_ms ||
+            queue_min_buffers <= 0 || queue_max_buffers < queue_min_buffers)) {
+        g_printerr("--adaptive-jitter needs 0 < min <= max for latency and queue bounds\n");
+        return 1;
+    }
+
+    if (record_dir) {
+        if (g_strcmp0(record_format, "mp4") != 0 && g_strcmp0(record_format, "mkv") != 0) {
+            g_printerr("Unknown --record-format '%s' (mp4, mkv)\n", record_format);
+            return 1;
+        }
+        if (record_segment_s <= 0) {
+            g_printerr("--record-segment must be positive\n");
+            return 1;
+        }
+        if (g_mkdir_with_parents(record_dir, 0755) != 0) {
+            g_printerr("Cannot create --record directory '%s'\n", record_dir);
+            return 1;
+        }
+    }
+
+    if (decoder_thread_budget <= 0)
+        decoder_thread_budget = (gint)g_get_num_processors();
+    if (g_strcmp0(decode_threading, "slice") != 0 && g_strcmp0(decode_threading, "frame") != 0 &&
+        g_strcmp0(decode_threading, "auto") != 0) {
+        g_printerr("Unknown --decode-threading '%s' (slice, frame, auto)\n", decode_threading);
+        return 1;
+    }
+    if (decode_low_delay)
+        decode_threading = "slice";
+
+    backoff_init(&reconnect_backoff, RECONNECT_BASE_MS, RECONNECT_MAX_MS);
+
+    rx_peer = g_string_sized_new(64);
+    rx_text = g_string_sized_new(4096);
+    tx_text = g_string_sized_new(4096);
+    signaling_queue_init(&tx_queue);
+    signaling_queue_set_sent_func(&tx_queue, on_frame_sent, NULL);
+
     loop = g_main_loop_new(NULL, FALSE);
 
+    if (adaptive_jitter) {
+        jitter_source = g_timeout_add(JITTER_INTERVAL_MS, on_jitter_tick, NULL);
+        g_print("[receiver] adaptive jitter buffer %d..%d ms, rxq %d..%d buffers\n",
+            jitter_min_ms, jitter_max_ms, queue_min_buffers, queue_max_buffers);
+    }
+
     connect_to_server_async();
     g_main_loop_run(loop);
 
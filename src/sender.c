@@ -6,6 +6,23 @@
  *    (same structure: libsoup websocket signaling + json-glib + webrtcbin callbacks)
  *  - Your gst-launch pipepline idea:
  *      mfvideosrc ! ... ! x264enc tune=zerolatency ... ! h264parse ! rtph264pay pt=96 ... ! (instead of udpsink) -> webrtcbin
+ *  - --fanout: the chain above ends in a tee and each viewer gets its own webrtcbin
+ *    (signaling: {"join":"<id>"} / {"leave":"<id>"}, sdp/ice tagged with "peer")
+ *  - --source=auto picks mfvideosrc, v4l2src or pipewiresrc (capture.c), falling back
+ *    to videotestsrc; videoconvert is left out when the device delivers the
+ *    encoder's input format itself
+ *  - --encoder=auto picks the cheapest H.264 encoder present (encoder.c); x264enc
+ *    is the fallback, --bitrate/--gop map onto whichever one is used
+ *  - --simulcast: the capture is split into full/half/quarter layers, each with its
+ *    own encoder, funnelled into one RTP stream and offered with RIDs f;h;q
+ *  - --nack/--fec: retransmissions (RTX) and ULPFEC/RED on every transceiver; viewers'
+ *    PLIs become keyframes (at most one per --pli-interval), so --gop can be long
+ *  - a dropped signaling connection is redialled with jittered backoff while the
+ *    pipeline keeps PLAYING; only sessions whose media died are rebuilt
+ *  - --early-start: capture, encoder and webrtcbin come up while signaling connects;
+ *    the offer waits in the outbound queue and goes out as soon as the socket opens
+ *  - --stamp-frames: capture time rides along in an RTP header extension so the
+ *    receiver's --measure-latency can report glass-to-glass percentiles
  *
  * Build (Linux):
  *  gcc sender.c -o sender \
@@ -15,6 +32,7 @@
 
 #include <gst/gst.h>
 #include <gst/sdp/sdp.h>
+#include <gst/rtp/rtp.h>
 #define GST_USE_UNSTABLE_API
 #include <gst/webrtc/webrtc.h>
 
@@ -23,31 +41,163 @@
 
 #include <string.h>
 
+#include "backoff.h"
+#include "bwe.h"
+#include "capture.h"
+#include "convert.h"
+#include "encoder.h"
+#include "latency_stamp.h"
+#include "signaling.h"
+#include "signaling_queue.h"
+#include "timeline.h"
+
 #define STUN_SERVER " stun-server=stun://stun.l.google.com:19302 "
 #define RTP_CAPS_H264 "application/x-rtp,media=video,encoding-name=H264,payload=96"
+#define RTP_TWCC_URI "http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01"
+#define RTP_RID_URI "urn:ietf:params:rtp-hdrext:sdes:rtp-stream-id"
+#define CAPTURE_WIDTH 640
+#define CAPTURE_HEIGHT 360
+#define CAPTURE_FPS 30
+
+typedef enum {
+    NEGOTIATION_NEW = 0,
+    NEGOTIATION_OFFER_SENT,
+    NEGOTIATION_STABLE,         /* remote answer applied */
+} NegotiationState;
+
+typedef struct {
+    gint64 created_us;
+    guint sdp_sent;
+    guint sdp_received;
+    guint ice_sent;
+    guint ice_received;
+    guint ice_frames_sent;      /* < ice_sent when batching */
+    gsize bytes_sent;           /* signaling payload sent, before any deflate */
+    gsize bytes_received;
+    gint64 send_us;             /* time libsoup spent sending its frames (and deflating) */
+} SessionStats;
+
+/* Remote candidate that arrived before the answer it belongs to */
+typedef struct {
+    guint mlineindex;
+    gchar* candidate;
+} PendingIce;
+
+/*
+ * One Session per remote viewer. Capture -> x264enc -> rtph264pay runs once and
+ * ends in "videotee"; every session hangs its own queue + webrtcbin off a tee
+ * request pad. In the default mode there is exactly one session with id ""
+ * (untagged signaling); with --fanout sessions come and go on join/leave.
+ * Sessions are only mutated from the main loop.
+ */
+typedef struct {
+    gchar* id;
+    GstElement* queue;
+    GstElement* webrtc;
+    GstPad* tee_pad;
+    NegotiationState state;
+    GQueue pending_ice;             /* PendingIce*, flushed once the answer is set */
+    GString* ice_batch;             /* local candidates waiting for the batch timer */
+    gboolean ice_batch_binary;      /* format the batch items were written in */
+    guint ice_batch_count;
+    guint ice_batch_source;
+    SessionStats stats;
+    Timeline timeline;
+    gboolean timeline_reported;
+    gboolean peer_left;             /* announced as left while its media was up */
+    BweController bwe;              /* RTCP path, when rtpgccbwe is not installed */
+    GstElement* gccbwe;             /* TWCC path */
+    gint estimate_kbps;             /* atomic; 0 until the first estimate */
+} Session;
 
  /* ---------- Globals ---------- */
 static GMainLoop* loop = NULL;
 static GstElement* pipep = NULL;
-static GstElement* webrtc = NULL;
+static GstElement* tee = NULL;
+static GHashTable* sessions = NULL; /* peer id -> Session* */
 
 static SoupWebsocketConnection* ws_conn = NULL;
+static gint64 ws_connected_us = 0;  /* copied into every session's timeline */
+static gint64 pipeline_started_us = 0;
+static gboolean ws_deflate = FALSE; /* permessage-deflate negotiated on ws_conn */
+static SignalingQueue tx_queue;     /* outbound frames; holds them while disconnected */
+
+/* Redial the signaling server instead of quitting; media is not touched */
+#define RECONNECT_BASE_MS 500
+#define RECONNECT_MAX_MS  30000
+static gboolean reconnect = TRUE;
+static Backoff reconnect_backoff;
+static guint reconnect_source = 0;
 
 static const gchar* server_url = "wss://108.130.0.118:8080"; /* change to your WSS */
 static gboolean disable_ssl = TRUE;
+static gboolean fanout = FALSE;
+/* Warm up capture and encoder while signaling connects; the offer waits in tx_queue */
+static gboolean early_start = FALSE;
+
+/* Inbound scratch buffers: grown once, reused for every message */
+static GString* rx_peer = NULL;
+static GString* rx_text = NULL;
+
+/* Outbound buffer: every envelope is written into it and sent from it */
+static GString* tx_text = NULL;
+
+/* Coalesce local candidates for this long into one {"ice":[...]} frame; 0 = off */
+static gint ice_batch_ms = 0;
+
+/* Offer the binary signaling subprotocol; the server's pick decides per connection */
+static gboolean binary_signaling = FALSE;
+static gboolean compress_signaling = FALSE;
+
+/* Video source: "auto" probes for a camera, falling back to a test pattern */
+static gchar* source_name = "auto";
+static gchar* source_device = NULL;
+static gboolean zero_copy = FALSE;
+static const CaptureBackend* capture_backend = NULL;
+
+/* H.264 encoder: "auto" probes for the cheapest one present */
+static gchar* encoder_name = "auto";
+static const EncoderBackend* encoder_backend = NULL;
+static gint bitrate_kbps = 1500;
+static gint gop_frames = 15;
+
+/* Retarget bitrate (and resolution) from per-viewer bandwidth estimates */
+static gboolean adaptive_bitrate = FALSE;
+static gint min_bitrate_kbps = 150;
+static gint max_bitrate_kbps = 0;   /* 0 = --bitrate */
+static gboolean use_gccbwe = FALSE; /* rtpgccbwe installed: TWCC instead of RTCP loss */
+static GstElement* encoder = NULL;
+static GstElement* scale_caps = NULL;
+static guint current_kbps = 0;
+static guint current_width = CAPTURE_WIDTH;
+static guint current_height = CAPTURE_HEIGHT;
+static guint abr_source = 0;
+
+/* Encode several layers from one capture, announced as RIDs (--simulcast) */
+static gboolean simulcast = FALSE;
+
+typedef struct {
+    const gchar* rid;
+    guint scale_down;       /* capture size divided by this */
+    guint bitrate_percent;  /* share of --bitrate */
+} SimulcastLayer;
+
+/* Highest first, which is also the order of a=simulcast */
+static const SimulcastLayer simulcast_layers[] = {
+    { "f", 1, 100 },
+    { "h", 2, 35 },
+    { "q", 4, 12 },
+};
 
-/* ---------- Helpers: JSON stringify ---------- */
-static gchar*
-json_object_to_string(JsonObject* object)
-{
-    JsonNode* root = json_node_init_object(json_node_alloc(), object);
-    JsonGenerator* gen = json_generator_new();
-    json_generator_set_root(gen, root);
-    gchar* text = json_generator_to_data(gen, NULL);
-    g_object_unref(gen);
-    json_node_free(root);
-    return text;
-}
+/* Loss recovery: RTX on NACK, ULPFEC/RED at this share of the bitrate, and
+ * keyframes on PLI no closer together than --pli-interval */
+static gboolean nack = FALSE;
+static gint fec_percentage = 0;
+static gint pli_interval_ms = 300;
+
+/* Stamp capture time into every RTP packet for the receiver's --measure-latency */
+static gboolean stamp_frames = FALSE;
+static LatencyStampMap* capture_times = NULL;
 
 /* ---------- Cleanup ---------- */
 static gboolean
@@ -63,12 +213,26 @@ cleanup_and_quit(const gchar* msg)
             g_clear_object(&ws_conn);
     }
 
+    if (loop)
+        g_print("[sender] Signaling queue: %s\n", signaling_queue_write_report(&tx_queue, tx_text));
+    signaling_queue_clear(&tx_queue);
+
+    g_clear_handle_id(&abr_source, g_source_remove);
+    g_clear_handle_id(&reconnect_source, g_source_remove);
+
+    /* Sessions unlink themselves from the tee, so they go before the pipeline */
+    g_clear_pointer(&sessions, g_hash_table_destroy);
+
     if (pipep) {
         gst_element_set_state(pipep, GST_STATE_NULL);
+        gst_clear_object(&tee);
+        gst_clear_object(&encoder);
+        gst_clear_object(&scale_caps);
         g_clear_object(&pipep);
-        webrtc = NULL;
     }
 
+    g_clear_pointer(&capture_times, latency_stamp_map_free);
+
     if (loop) {
         g_main_loop_quit(loop);
         g_clear_pointer(&loop, g_main_loop_unref);
@@ -77,93 +241,1074 @@ cleanup_and_quit(const gchar* msg)
     return G_SOURCE_REMOVE;
 }
 
-/* ---------- Signaling: send ICE ---------- */
+/* ---------- Signaling: framing ---------- */
+static gboolean
+conn_is_binary(SoupWebsocketConnection* conn)
+{
+    return g_strcmp0(soup_websocket_connection_get_protocol(conn), SIGNALING_PROTOCOL_BINARY) == 0;
+}
+
+static gboolean
+conn_is_deflated(SoupWebsocketConnection* conn)
+{
+    for (GList* l = soup_websocket_connection_get_extensions(conn); l; l = l->next) {
+        if (SOUP_IS_WEBSOCKET_EXTENSION_DEFLATE(l->data))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Frames are written for the connection the queue sends on. Until one is
+ * open that is JSON, which every end parses whatever the subprotocol. */
+static gboolean
+tx_binary(void)
+{
+    return tx_queue.conn && conn_is_binary(tx_queue.conn);
+}
+
+/* tx_text holds a frame written by signaling_write_*() in tx_binary()'s format */
 static void
-send_ice_candidate(GstElement* webrtcbin, guint mlineindex, gchar* candidate, gpointer user_data)
+send_tx_frame(Session* session, SignalingPriority priority, gboolean binary)
+{
+    signaling_queue_push(&tx_queue, priority, session->id, binary, tx_text->str, tx_text->len);
+}
+
+/* tx_queue handed a frame to libsoup, which deflates inside the send call:
+ * that is the per-frame CPU cost, credited to the peer the frame is for */
+static void
+on_frame_sent(const gchar* peer, gsize len, gint64 send_us, gpointer user_data)
 {
-    (void)webrtcbin;
     (void)user_data;
+    Session* session = sessions && peer ? g_hash_table_lookup(sessions, peer) : NULL;
 
-    if (!ws_conn || soup_websocket_connection_get_state(ws_conn) != SOUP_WEBSOCKET_STATE_OPEN)
+    if (!session)
         return;
+    session->stats.send_us += send_us;
+    session->stats.bytes_sent += len;
+}
 
-    JsonObject* ice = json_object_new();
-    json_object_set_string_member(ice, "candidate", candidate);
-    json_object_set_int_member(ice, "sdpMLineIndex", (gint)mlineindex);
+/* ---------- Signaling: send ICE ---------- */
+static void
+flush_ice_batch(Session* session)
+{
+    g_clear_handle_id(&session->ice_batch_source, g_source_remove);
 
-    JsonObject* msg = json_object_new();
-    json_object_set_object_member(msg, "ice", ice);
+    if (session->ice_batch_count == 0)
+        return;
 
-    gchar* text = json_object_to_string(msg);
-    json_object_unref(msg);
+    gboolean binary = session->ice_batch_binary;
+    if (binary)
+        signaling_write_ice_batch_binary(tx_text, session->id, session->ice_batch);
+    else
+        signaling_write_ice_batch(tx_text, session->id, session->ice_batch, session->ice_batch_count);
+    send_tx_frame(session, SIGNALING_PRIORITY_ICE, binary);
+    session->stats.ice_sent += session->ice_batch_count;
+    session->stats.ice_frames_sent++;
+
+    g_string_truncate(session->ice_batch, 0);
+    session->ice_batch_count = 0;
+}
 
-    soup_websocket_connection_send_text(ws_conn, text);
-    g_free(text);
+static gboolean
+on_ice_batch_timeout(gpointer user_data)
+{
+    Session* session = user_data;
+
+    session->ice_batch_source = 0;
+    flush_ice_batch(session);
+    return G_SOURCE_REMOVE;
 }
 
-/* ---------- Signaling: send SDP ---------- */
 static void
-send_sdp(GstWebRTCSessionDescription* desc)
+send_ice_candidate(Session* session, guint mlineindex, const gchar* candidate)
 {
-    if (!ws_conn || soup_websocket_connection_get_state(ws_conn) != SOUP_WEBSOCKET_STATE_OPEN)
+    if (ice_batch_ms <= 0) {
+        gboolean binary = tx_binary();
+        if (binary)
+            signaling_write_ice_binary(tx_text, session->id, mlineindex, candidate);
+        else
+            signaling_write_ice(tx_text, session->id, mlineindex, candidate);
+        send_tx_frame(session, SIGNALING_PRIORITY_ICE, binary);
+        session->stats.ice_sent++;
+        session->stats.ice_frames_sent++;
         return;
+    }
 
-    gchar* sdp_text = gst_sdp_message_as_text(desc->sdp);
+    if (!session->ice_batch)
+        session->ice_batch = g_string_sized_new(1024);
+    /* A batch keeps the format it was started in, even across a reconnect */
+    if (session->ice_batch_count == 0)
+        session->ice_batch_binary = tx_binary();
+    if (session->ice_batch_binary) {
+        signaling_append_ice_binary(session->ice_batch, mlineindex, candidate);
+    }
+    else {
+        if (session->ice_batch_count > 0)
+            g_string_append_c(session->ice_batch, ',');
+        signaling_append_ice(session->ice_batch, mlineindex, candidate);
+    }
+    session->ice_batch_count++;
 
-    JsonObject* sdp = json_object_new();
-    json_object_set_string_member(sdp, "type",
-        desc->type == GST_WEBRTC_SDP_TYPE_OFFER ? "offer" : "answer");
-    json_object_set_string_member(sdp, "sdp", sdp_text);
+    /* The window opens with the first candidate; a full batch goes out at once */
+    if (session->ice_batch_count >= SIGNALING_ICE_BATCH_MAX)
+        flush_ice_batch(session);
+    else if (!session->ice_batch_source)
+        session->ice_batch_source = g_timeout_add((guint)ice_batch_ms, on_ice_batch_timeout, session);
+}
 
-    JsonObject* msg = json_object_new();
-    json_object_set_object_member(msg, "sdp", sdp);
+/* ---------- Signaling: send SDP ---------- */
+static void
+send_sdp(Session* session, GstWebRTCSessionDescription* desc)
+{
+    /* Batched candidates are queued too; the description still goes first */
+    flush_ice_batch(session);
 
-    gchar* text = json_object_to_string(msg);
-    json_object_unref(msg);
+    gchar* sdp_text = gst_sdp_message_as_text(desc->sdp);
+    const gchar* sdp_type = desc->type == GST_WEBRTC_SDP_TYPE_OFFER ? "offer" : "answer";
+    gboolean binary = tx_binary();
 
-    soup_websocket_connection_send_text(ws_conn, text);
+    if (binary)
+        signaling_write_sdp_binary(tx_text, session->id, sdp_type, sdp_text);
+    else
+        signaling_write_sdp(tx_text, session->id, sdp_type, sdp_text);
+    send_tx_frame(session, SIGNALING_PRIORITY_SDP, binary);
 
-    g_free(text);
     g_free(sdp_text);
+    session->stats.sdp_sent++;
+    timeline_mark(&session->timeline,
+        desc->type == GST_WEBRTC_SDP_TYPE_OFFER ? TIMELINE_OFFER_SENT : TIMELINE_ANSWER_SENT);
 }
 
-/* ---------- Offer created callback ---------- */
+/* ---------- Signaling: hop from webrtcbin threads to the main loop ---------- */
+/*
+ * webrtcbin emits on-ice-candidate and replies to promises from its own
+ * threads. The websocket and the session table belong to the main loop, so
+ * outgoing messages are handed over by peer id; if the session is gone by the
+ * time the main loop runs, the message is dropped.
+ */
+typedef struct {
+    gchar* peer_id;
+    GstWebRTCSessionDescription* desc; /* NULL for an ICE candidate */
+    guint mlineindex;
+    gchar* candidate;
+} OutboundMessage;
+
 static void
-on_offer_created(GstPromise* promise, gpointer user_data)
+outbound_message_free(gpointer data)
+{
+    OutboundMessage* out = data;
+    g_free(out->peer_id);
+    if (out->desc)
+        gst_webrtc_session_description_free(out->desc);
+    g_free(out->candidate);
+    g_free(out);
+}
+
+static gboolean
+send_outbound_message(gpointer data)
+{
+    OutboundMessage* out = data;
+    Session* session = sessions ? g_hash_table_lookup(sessions, out->peer_id) : NULL;
+
+    if (!session)
+        return G_SOURCE_REMOVE;
+
+    if (out->desc) {
+        GstPromise* p = gst_promise_new();
+        g_signal_emit_by_name(session->webrtc, "set-local-description", out->desc, p);
+        gst_promise_interrupt(p);
+        gst_promise_unref(p);
+
+        g_print("[sender] Sending SDP offer to '%s'\n", session->id);
+        send_sdp(session, out->desc);
+        session->state = NEGOTIATION_OFFER_SENT;
+    }
+    else
+        send_ice_candidate(session, out->mlineindex, out->candidate);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+queue_outbound_message(OutboundMessage* out)
+{
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT,
+        send_outbound_message, out, outbound_message_free);
+}
+
+static void
+on_ice_candidate(GstElement* webrtcbin, guint mlineindex, gchar* candidate, gpointer user_data)
+{
+    (void)webrtcbin;
+    Session* session = user_data;
+
+    timeline_mark(&session->timeline, TIMELINE_FIRST_LOCAL_ICE);
+
+    OutboundMessage* out = g_new0(OutboundMessage, 1);
+    out->peer_id = g_strdup(session->id);
+    out->mlineindex = mlineindex;
+    out->candidate = g_strdup(candidate);
+    queue_outbound_message(out);
+}
+
+/* ---------- Connection-setup timeline ---------- */
+static void
+report_timeline(Session* session)
+{
+    if (session->timeline_reported)
+        return;
+    session->timeline_reported = TRUE;
+    g_print("[sender] timeline %s\n",
+        timeline_write_json(&session->timeline, tx_text, "sender", session->id));
+}
+
+static gboolean
+report_timeline_by_id(gpointer data)
+{
+    Session* session = sessions ? g_hash_table_lookup(sessions, data) : NULL;
+
+    if (session)
+        report_timeline(session);
+    return G_SOURCE_REMOVE;
+}
+
+/* A milestone reached off the main loop, stamped there and applied by peer id */
+typedef struct {
+    gchar* peer_id;
+    TimelineMilestone milestone;
+    gint64 at_us;
+} TimelineStamp;
+
+static void
+timeline_stamp_free(gpointer data)
+{
+    TimelineStamp* stamp = data;
+    g_free(stamp->peer_id);
+    g_free(stamp);
+}
+
+static gboolean
+apply_timeline_stamp(gpointer data)
+{
+    TimelineStamp* stamp = data;
+    Session* session = sessions ? g_hash_table_lookup(sessions, stamp->peer_id) : NULL;
+
+    if (session)
+        timeline_mark_at(&session->timeline, stamp->milestone, stamp->at_us);
+    return G_SOURCE_REMOVE;
+}
+
+/* webrtcbin thread; user_data is the peer id. answer_set is when webrtcbin
+ * has applied the answer, not when it was handed over. */
+static void
+on_answer_set(GstPromise* promise, gpointer user_data)
+{
+    const gchar* peer_id = user_data;
+    gint64 now = g_get_monotonic_time();
+
+    if (gst_promise_wait(promise) != GST_PROMISE_RESULT_REPLIED) {
+        gst_promise_unref(promise);
+        return;
+    }
+
+    const GstStructure* reply = gst_promise_get_reply(promise);
+    GError* error = NULL;
+    if (reply && gst_structure_get(reply, "error", G_TYPE_ERROR, &error, NULL)) {
+        g_printerr("[sender] Answer from '%s' not applied: %s\n", peer_id, error->message);
+        g_error_free(error);
+        gst_promise_unref(promise);
+        return;
+    }
+    gst_promise_unref(promise);
+
+    TimelineStamp* stamp = g_new0(TimelineStamp, 1);
+    stamp->peer_id = g_strdup(peer_id);
+    stamp->milestone = TIMELINE_ANSWER_SET;
+    stamp->at_us = now;
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT,
+        apply_timeline_stamp, stamp, timeline_stamp_free);
+}
+
+static void
+on_ice_connection_state(GstElement* webrtcbin, GParamSpec* pspec, gpointer user_data)
+{
+    (void)pspec;
+    Session* session = user_data;
+    GstWebRTCICEConnectionState state;
+
+    g_object_get(webrtcbin, "ice-connection-state", &state, NULL);
+    if (state == GST_WEBRTC_ICE_CONNECTION_STATE_CONNECTED ||
+        state == GST_WEBRTC_ICE_CONNECTION_STATE_COMPLETED)
+        timeline_mark(&session->timeline, TIMELINE_ICE_CONNECTED);
+}
+
+static void remove_session(const gchar* peer_id);
+
+/* Main loop: a peer that left signaling goes once its media is gone too */
+static gboolean
+reap_left_session(gpointer data)
+{
+    const gchar* peer_id = data;
+    Session* session = sessions ? g_hash_table_lookup(sessions, peer_id) : NULL;
+
+    if (session && session->peer_left)
+        remove_session(peer_id);
+    return G_SOURCE_REMOVE;
+}
+
+/* The peer connection only reports "connected" once DTLS is done on top of ICE */
+static void
+on_connection_state(GstElement* webrtcbin, GParamSpec* pspec, gpointer user_data)
+{
+    (void)pspec;
+    Session* session = user_data;
+    GstWebRTCPeerConnectionState state;
+
+    g_object_get(webrtcbin, "connection-state", &state, NULL);
+    if (state == GST_WEBRTC_PEER_CONNECTION_STATE_CONNECTED)
+        timeline_mark(&session->timeline, TIMELINE_DTLS_CONNECTED);
+    else if (state == GST_WEBRTC_PEER_CONNECTION_STATE_DISCONNECTED ||
+             state == GST_WEBRTC_PEER_CONNECTION_STATE_FAILED ||
+             state == GST_WEBRTC_PEER_CONNECTION_STATE_CLOSED)
+        g_idle_add_full(G_PRIORITY_DEFAULT, reap_left_session, g_strdup(session->id), g_free);
+}
+
+/* Streaming thread. webrtcbin drops media until DTLS is up, so the first
+ * packet after that is the first one that actually leaves for the viewer. */
+static GstPadProbeReturn
+on_session_rtp(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    (void)pad;
+    (void)info;
+    Session* session = user_data;
+
+    if (!timeline_has(&session->timeline, TIMELINE_DTLS_CONNECTED))
+        return GST_PAD_PROBE_OK;
+
+    timeline_mark(&session->timeline, TIMELINE_FIRST_RTP);
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT,
+        report_timeline_by_id, g_strdup(session->id), g_free);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+/* ---------- Adaptive bitrate (--adaptive-bitrate) ---------- */
+/*
+ * Each session keeps its own estimate: rtpgccbwe's delay/loss estimate from
+ * TWCC feedback when the plugin is installed, otherwise BweController fed
+ * from webrtcbin's RTCP stats. Viewers share one encoder, so once a second
+ * the lowest estimate becomes the encoder's bitrate, and the resolution
+ * follows the bitrate down the bwe.c ladder.
+ */
+#define ABR_INTERVAL_MS 1000
+
+typedef struct {
+    gchar* peer_id;
+    gdouble fraction_lost;
+    gdouble rtt;
+    gboolean found;
+} ReceiverReport;
+
+static void
+receiver_report_free(gpointer data)
+{
+    ReceiverReport* report = data;
+    g_free(report->peer_id);
+    g_free(report);
+}
+
+static void
+on_gcc_estimate(GObject* gccbwe, GParamSpec* pspec, gpointer user_data)
+{
+    (void)pspec;
+    Session* session = user_data;
+    guint bps = 0;
+
+    g_object_get(gccbwe, "estimated-bitrate", &bps, NULL);
+    g_atomic_int_set(&session->estimate_kbps, (gint)(bps / 1000));
+}
+
+/* webrtcbin asks once per transport; rtpgccbwe consumes its TWCC feedback */
+static GstElement*
+on_request_aux_sender(GstElement* webrtcbin, GObject* dtls_transport, gpointer user_data)
+{
+    (void)webrtcbin;
+    (void)dtls_transport;
+    Session* session = user_data;
+
+    if (session->gccbwe)
+        return NULL;
+
+    GstElement* gccbwe = gst_element_factory_make("rtpgccbwe", NULL);
+    if (!gccbwe)
+        return NULL;
+
+    g_object_set(gccbwe,
+        "min-bitrate", (guint)min_bitrate_kbps * 1000,
+        "max-bitrate", (guint)max_bitrate_kbps * 1000,
+        "estimated-bitrate", current_kbps * 1000,
+        NULL);
+    g_signal_connect(gccbwe, "notify::estimated-bitrate", G_CALLBACK(on_gcc_estimate), session);
+    session->gccbwe = gst_object_ref(gccbwe);
+    return gccbwe;
+}
+
+static gboolean
+find_remote_inbound(GQuark field_id, const GValue* value, gpointer user_data)
+{
+    (void)field_id;
+    ReceiverReport* report = user_data;
+
+    if (!GST_VALUE_HOLDS_STRUCTURE(value))
+        return TRUE;
+
+    const GstStructure* stats = gst_value_get_structure(value);
+    GstWebRTCStatsType type;
+    if (!gst_structure_get(stats, "type", GST_TYPE_WEBRTC_STATS_TYPE, &type, NULL) ||
+        type != GST_WEBRTC_STATS_REMOTE_INBOUND_RTP)
+        return TRUE;
+
+    gst_structure_get_double(stats, "fraction-lost", &report->fraction_lost);
+    gst_structure_get_double(stats, "round-trip-time", &report->rtt);
+    report->found = TRUE;
+    return FALSE;
+}
+
+static gboolean
+apply_receiver_report(gpointer data)
+{
+    ReceiverReport* report = data;
+    Session* session = sessions ? g_hash_table_lookup(sessions, report->peer_id) : NULL;
+
+    if (session)
+        session->estimate_kbps = (gint)bwe_on_report(&session->bwe, report->fraction_lost, report->rtt);
+    return G_SOURCE_REMOVE;
+}
+
+/* webrtcbin thread; user_data is the peer id */
+static void
+on_stats(GstPromise* promise, gpointer user_data)
+{
+    if (gst_promise_wait(promise) != GST_PROMISE_RESULT_REPLIED) {
+        gst_promise_unref(promise);
+        return;
+    }
+
+    ReceiverReport* report = g_new0(ReceiverReport, 1);
+    gst_structure_foreach(gst_promise_get_reply(promise), find_remote_inbound, report);
+    report->peer_id = g_strdup(user_data);
+    gst_promise_unref(promise);
+
+    /* No receiver report yet: nothing to learn */
+    if (!report->found) {
+        receiver_report_free(report);
+        return;
+    }
+
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT,
+        apply_receiver_report, report, receiver_report_free);
+}
+
+static void
+apply_target_bitrate(guint kbps)
+{
+    kbps = CLAMP(kbps, (guint)min_bitrate_kbps, (guint)max_bitrate_kbps);
+
+    /* Ignore jitter in the estimate; every change costs the encoder a bit */
+    if (kbps * 20 > current_kbps * 19 && kbps * 20 < current_kbps * 21)
+        return;
+
+    current_kbps = kbps;
+    encoder_backend_set_bitrate(encoder_backend, encoder, kbps);
+
+    guint width, height;
+    bwe_resolution_for(kbps, CAPTURE_WIDTH, CAPTURE_HEIGHT, &width, &height);
+    if (width != current_width || height != current_height) {
+        GstCaps* caps = gst_caps_new_simple("video/x-raw",
+            "width", G_TYPE_INT, (gint)width,
+            "height", G_TYPE_INT, (gint)height,
+            NULL);
+        g_object_set(scale_caps, "caps", caps, NULL);
+        gst_caps_unref(caps);
+        current_width = width;
+        current_height = height;
+    }
+
+    g_print("[sender] bitrate -> %u kbit/s at %ux%u\n", kbps, width, height);
+}
+
+static gboolean
+on_abr_tick(gpointer user_data)
 {
     (void)user_data;
 
+    guint target = 0;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, sessions);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        Session* session = value;
+
+        /* Answer lands on the next tick */
+        if (!use_gccbwe) {
+            GstPromise* p = gst_promise_new_with_change_func(on_stats, g_strdup(session->id), g_free);
+            g_signal_emit_by_name(session->webrtc, "get-stats", NULL, p);
+        }
+
+        guint kbps = (guint)g_atomic_int_get(&session->estimate_kbps);
+        if (kbps > 0 && (target == 0 || kbps < target))
+            target = kbps;
+    }
+
+    if (target > 0)
+        apply_target_bitrate(target);
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+start_adaptive_bitrate(void)
+{
+    encoder = gst_bin_get_by_name(GST_BIN(pipep), "encoder");
+    scale_caps = gst_bin_get_by_name(GST_BIN(pipep), "scalecaps");
+    if (!encoder || !scale_caps) {
+        g_printerr("[sender] Failed to get encoder/scalecaps for --adaptive-bitrate\n");
+        return FALSE;
+    }
+
+    /* rtpgccbwe needs transport-wide sequence numbers on every packet */
+    if (use_gccbwe) {
+        GstElement* pay = gst_bin_get_by_name(GST_BIN(pipep), "pay");
+        GstRTPHeaderExtension* twcc = gst_rtp_header_extension_create_from_uri(RTP_TWCC_URI);
+        if (pay && twcc) {
+            gst_rtp_header_extension_set_id(twcc, 1);
+            g_signal_emit_by_name(pay, "add-extension", twcc);
+        }
+        else {
+            g_print("[sender] TWCC extension unavailable, estimating from RTCP instead\n");
+            use_gccbwe = FALSE;
+        }
+        gst_clear_object(&twcc);
+        gst_clear_object(&pay);
+    }
+
+    current_kbps = (guint)bitrate_kbps;
+    abr_source = g_timeout_add(ABR_INTERVAL_MS, on_abr_tick, NULL);
+    g_print("[sender] adaptive bitrate %d..%d kbit/s (%s)\n", min_bitrate_kbps, max_bitrate_kbps,
+        use_gccbwe ? "rtpgccbwe/TWCC" : "RTCP loss/RTT");
+    return TRUE;
+}
+
+/* ---------- Loss recovery (--nack, --fec, PLI) ---------- */
+static void
+configure_transceiver(Session* session)
+{
+    GstWebRTCRTPTransceiver* trans = NULL;
+    g_signal_emit_by_name(session->webrtc, "get-transceiver", 0, &trans);
+    if (!trans)
+        return;
+
+    /* Must be set before the offer is created: both end up in the SDP */
+    g_object_set(trans, "do-nack", nack, NULL);
+    if (fec_percentage > 0)
+        g_object_set(trans,
+            "fec-type", GST_WEBRTC_FEC_TYPE_ULP_RED,
+            "fec-percentage", (guint)fec_percentage,
+            NULL);
+    gst_object_unref(trans);
+}
+
+/*
+ * rtpsession turns a viewer's PLI/FIR into a GstForceKeyUnit event that
+ * travels upstream through the tee to the encoder. With many viewers on one
+ * encoder a burst of losses would mean a burst of keyframes; this lets one
+ * through per --pli-interval. Requests inside the window are coalesced: the
+ * latest is held and sent once the window ends, so a viewer whose loss came
+ * just after a keyframe still gets one.
+ */
+typedef struct {
+    gchar* encoder_name;
+    GstPad* pad;            /* encoder src; owns the probe, hence no ref */
+    GMutex lock;
+    gint64 last_us;
+    GstEvent* pending;      /* held until the window ends */
+    GstEvent* replaying;    /* the held event on its way back through the probe */
+    guint timer;
+    guint requested;
+    guint forwarded;
+    guint coalesced;
+} KeyframeLimiter;
+
+static void
+keyframe_limiter_free(gpointer data)
+{
+    KeyframeLimiter* limiter = data;
+    g_print("[sender] %s: %u keyframe requests, %u forwarded, %u coalesced\n",
+        limiter->encoder_name, limiter->requested, limiter->forwarded, limiter->coalesced);
+    if (limiter->timer)
+        g_source_remove(limiter->timer);
+    gst_event_replace(&limiter->pending, NULL);
+    g_mutex_clear(&limiter->lock);
+    g_free(limiter->encoder_name);
+    g_free(limiter);
+}
+
+/* Main loop: the window is over, send what came in during it */
+static gboolean
+on_keyframe_window_end(gpointer user_data)
+{
+    KeyframeLimiter* limiter = user_data;
+
+    g_mutex_lock(&limiter->lock);
+    limiter->timer = 0;
+    GstEvent* event = limiter->pending;
+    limiter->pending = NULL;
+    limiter->replaying = event;
+    g_mutex_unlock(&limiter->lock);
+
+    if (event)
+        gst_pad_send_event(limiter->pad, event);
+    return G_SOURCE_REMOVE;
+}
+
+/* Any viewer's RTCP thread */
+static GstPadProbeReturn
+on_keyframe_request(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    (void)pad;
+    KeyframeLimiter* limiter = user_data;
+    GstEvent* event = GST_PAD_PROBE_INFO_EVENT(info);
+
+    if (!gst_event_has_name(event, "GstForceKeyUnit"))
+        return GST_PAD_PROBE_OK;
+
+    gint64 now = g_get_monotonic_time();
+    gint64 window_us = (gint64)pli_interval_ms * 1000;
+    gboolean forward;
+
+    g_mutex_lock(&limiter->lock);
+    if (event == limiter->replaying) {
+        limiter->replaying = NULL;
+        /* Unless another request got through while it was on its way */
+        forward = now - limiter->last_us >= window_us;
+        if (!forward) {
+            limiter->coalesced++;
+            g_mutex_unlock(&limiter->lock);
+            return GST_PAD_PROBE_DROP;
+        }
+    }
+    else {
+        limiter->requested++;
+        forward = limiter->last_us == 0 || now - limiter->last_us >= window_us;
+    }
+
+    if (forward) {
+        limiter->last_us = now;
+        limiter->forwarded++;
+        /* This keyframe answers whatever was held too */
+        if (limiter->pending)
+            limiter->coalesced++;
+        gst_event_replace(&limiter->pending, NULL);
+    }
+    else {
+        if (limiter->pending)
+            limiter->coalesced++;
+        gst_event_replace(&limiter->pending, event);
+        if (!limiter->timer) {
+            gint64 wait_us = limiter->last_us + window_us - now;
+            limiter->timer = g_timeout_add((guint)((wait_us + 999) / 1000),
+                on_keyframe_window_end, limiter);
+        }
+    }
+    g_mutex_unlock(&limiter->lock);
+
+    return forward ? GST_PAD_PROBE_OK : GST_PAD_PROBE_DROP;
+}
+
+static gboolean
+add_keyframe_limiter(const gchar* encoder_name)
+{
+    GstElement* element = gst_bin_get_by_name(GST_BIN(pipep), encoder_name);
+    if (!element) {
+        g_printerr("[sender] No '%s' to rate-limit keyframe requests on\n", encoder_name);
+        return FALSE;
+    }
+
+    KeyframeLimiter* limiter = g_new0(KeyframeLimiter, 1);
+    limiter->encoder_name = g_strdup(encoder_name);
+    g_mutex_init(&limiter->lock);
+
+    GstPad* pad = gst_element_get_static_pad(element, "src");
+    limiter->pad = pad;
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_UPSTREAM, on_keyframe_request,
+        limiter, keyframe_limiter_free);
+    gst_object_unref(pad);
+    gst_object_unref(element);
+    return TRUE;
+}
+
+/* ---------- Simulcast (--simulcast) ---------- */
+/*
+ * camtee feeds one videoscale + encoder + rtph264pay branch per layer. Every
+ * payloader tags its packets with its RID (rtp-stream-id header extension) and
+ * rtpfunnel merges them into one stream, so each viewer's webrtcbin sends all
+ * layers on one transceiver and an SFU picks per viewer without re-encoding.
+ */
+static gchar*
+describe_simulcast_layers(guint scale_threads)
+{
+    GString* desc = g_string_new(NULL);
+
+    for (guint i = 0; i < G_N_ELEMENTS(simulcast_layers); i++) {
+        const SimulcastLayer* layer = &simulcast_layers[i];
+        gchar* enc_name = g_strdup_printf("encoder_%s", layer->rid);
+        gchar* enc = encoder_backend_describe(encoder_backend, enc_name,
+            (guint)bitrate_kbps * layer->bitrate_percent / 100, (guint)gop_frames);
+
+        g_string_append_printf(desc,
+            " camtee. ! queue max-size-buffers=2 max-size-time=0 max-size-bytes=0 leaky=downstream ! "
+            "videoscale name=scale_%s n-threads=%u ! video/x-raw,width=%d,height=%d ! "
+            "%s ! "
+            "h264parse config-interval=1 ! "
+            "rtph264pay name=pay_%s pt=96 config-interval=1 aggregate-mode=zero-latency ! "
+            "simfunnel.",
+            layer->rid, scale_threads,
+            CAPTURE_WIDTH / layer->scale_down, CAPTURE_HEIGHT / layer->scale_down,
+            enc, layer->rid);
+
+        g_free(enc);
+        g_free(enc_name);
+    }
+
+    return g_string_free(desc, FALSE);
+}
+
+/* RID header extensions on the payloaders, rid-* fields on the funnel caps */
+static gboolean
+start_simulcast(void)
+{
+    GstCaps* caps = gst_caps_from_string(RTP_CAPS_H264);
+    GString* order = g_string_new("send ");
+
+    for (guint i = 0; i < G_N_ELEMENTS(simulcast_layers); i++) {
+        const SimulcastLayer* layer = &simulcast_layers[i];
+        gchar* name = g_strdup_printf("pay_%s", layer->rid);
+        GstElement* pay = gst_bin_get_by_name(GST_BIN(pipep), name);
+        g_free(name);
+
+        GstRTPHeaderExtension* ext = gst_rtp_header_extension_create_from_uri(RTP_RID_URI);
+        if (!pay || !ext) {
+            g_printerr("[sender] Failed to tag simulcast layer '%s' with its RID\n", layer->rid);
+            gst_clear_object(&pay);
+            gst_clear_object(&ext);
+            gst_caps_unref(caps);
+            g_string_free(order, TRUE);
+            return FALSE;
+        }
+        gst_rtp_header_extension_set_id(ext, 2);
+        g_object_set(ext, "rid", layer->rid, NULL);
+        g_signal_emit_by_name(pay, "add-extension", ext);
+        gst_object_unref(ext);
+        gst_object_unref(pay);
+
+        gchar* field = g_strdup_printf("rid-%s", layer->rid);
+        gst_caps_set_simple(caps, field, G_TYPE_STRING, "send", NULL);
+        g_free(field);
+        g_string_append_printf(order, "%s%s", i > 0 ? ";" : "", layer->rid);
+    }
+
+    gst_caps_set_simple(caps, "a-simulcast", G_TYPE_STRING, order->str, NULL);
+    g_string_free(order, TRUE);
+
+    GstElement* filter = gst_bin_get_by_name(GST_BIN(pipep), "simcaps");
+    if (filter) {
+        g_object_set(filter, "caps", caps, NULL);
+        gst_object_unref(filter);
+    }
+    gst_caps_unref(caps);
+    return filter != NULL;
+}
+
+/* webrtcbin versions without send-side simulcast drop the rid-* caps fields;
+ * add the lines ourselves so the remote still sees the layers */
+static void
+add_simulcast_attributes(GstSDPMessage* sdp)
+{
+    for (guint m = 0; m < gst_sdp_message_medias_len(sdp); m++) {
+        GstSDPMedia* media = (GstSDPMedia*)gst_sdp_message_get_media(sdp, m);
+
+        if (g_strcmp0(gst_sdp_media_get_media(media), "video") != 0 ||
+            gst_sdp_media_get_attribute_val(media, "simulcast"))
+            continue;
+
+        GString* order = g_string_new("send ");
+        for (guint i = 0; i < G_N_ELEMENTS(simulcast_layers); i++) {
+            gchar* rid = g_strdup_printf("%s send", simulcast_layers[i].rid);
+            gst_sdp_media_add_attribute(media, "rid", rid);
+            g_free(rid);
+            g_string_append_printf(order, "%s%s", i > 0 ? ";" : "", simulcast_layers[i].rid);
+        }
+        gst_sdp_media_add_attribute(media, "simulcast", order->str);
+        g_string_free(order, TRUE);
+    }
+}
+
+/* ---------- Offer created callback ---------- */
+/* webrtcbin thread; user_data is the peer id. The session may be gone by the
+ * time the offer is ready, so it is only looked up again on the main loop. */
+static void
+on_offer_created(GstPromise* promise, gpointer user_data)
+{
+    const gchar* peer_id = user_data;
     const GstStructure* reply = NULL;
     GstWebRTCSessionDescription* offer = NULL;
+    GError* error = NULL;
 
-    g_assert(gst_promise_wait(promise) == GST_PROMISE_RESULT_REPLIED);
+    /* Interrupted when the session is torn down mid-negotiation */
+    if (gst_promise_wait(promise) != GST_PROMISE_RESULT_REPLIED) {
+        gst_promise_unref(promise);
+        return;
+    }
     reply = gst_promise_get_reply(promise);
-    gst_structure_get(reply, "offer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &offer, NULL);
+    if (reply && gst_structure_get(reply, "error", G_TYPE_ERROR, &error, NULL)) {
+        g_printerr("[sender] create-offer for '%s' failed: %s\n", peer_id, error->message);
+        g_error_free(error);
+        gst_promise_unref(promise);
+        return;
+    }
+    if (reply)
+        gst_structure_get(reply, "offer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &offer, NULL);
     gst_promise_unref(promise);
 
-    /* Set local description */
-    GstPromise* p = gst_promise_new();
-    g_signal_emit_by_name(webrtc, "set-local-description", offer, p);
-    gst_promise_interrupt(p);
-    gst_promise_unref(p);
+    if (!offer) {
+        g_printerr("[sender] create-offer for '%s' returned no offer\n", peer_id);
+        return;
+    }
 
-    /* Send to peer */
-    g_print("[sender] Sending SDP offer\n");
-    send_sdp(offer);
+    if (simulcast)
+        add_simulcast_attributes(offer->sdp);
 
-    gst_webrtc_session_description_free(offer);
+    /* Set as local description and sent to the peer on the main loop */
+    OutboundMessage* out = g_new0(OutboundMessage, 1);
+    out->peer_id = g_strdup(peer_id);
+    out->desc = offer;
+    queue_outbound_message(out);
 }
 
 /* ---------- Negotiation needed (sender always creates offer) ---------- */
 static void
 on_negotiation_needed(GstElement* element, gpointer user_data)
 {
-    (void)element;
-    (void)user_data;
+    Session* session = user_data;
+
+    g_print("[sender] on-negotiation-needed for '%s' -> create-offer\n", session->id);
+    GstPromise* promise = gst_promise_new_with_change_func(on_offer_created,
+        g_strdup(session->id), g_free);
+    g_signal_emit_by_name(element, "create-offer", NULL, promise);
+}
+
+/* ---------- Sessions: one webrtcbin per viewer behind the tee ---------- */
+static void
+pending_ice_free(gpointer data)
+{
+    PendingIce* ice = data;
+    g_free(ice->candidate);
+    g_free(ice);
+}
+
+static void
+session_add_remote_ice(Session* session, guint mlineindex, const gchar* candidate)
+{
+    session->stats.ice_received++;
+    timeline_mark(&session->timeline, TIMELINE_FIRST_REMOTE_ICE);
+
+    if (session->state != NEGOTIATION_STABLE) {
+        PendingIce* ice = g_new0(PendingIce, 1);
+        ice->mlineindex = mlineindex;
+        ice->candidate = g_strdup(candidate);
+        g_queue_push_tail(&session->pending_ice, ice);
+        return;
+    }
+
+    g_signal_emit_by_name(session->webrtc, "add-ice-candidate", mlineindex, candidate);
+}
+
+static void
+session_flush_pending_ice(Session* session)
+{
+    PendingIce* ice;
+    while ((ice = g_queue_pop_head(&session->pending_ice))) {
+        g_signal_emit_by_name(session->webrtc, "add-ice-candidate", ice->mlineindex, ice->candidate);
+        pending_ice_free(ice);
+    }
+}
+
+static void
+session_free(gpointer data)
+{
+    Session* session = data;
+
+    /* Whatever was reached, for sessions that never got media flowing */
+    report_timeline(session);
+
+    g_print("[sender] Session '%s' closed after %.1fs (sdp tx/rx %u/%u, ice tx/rx %u/%u)\n",
+        session->id,
+        (g_get_monotonic_time() - session->stats.created_us) / (gdouble)G_USEC_PER_SEC,
+        session->stats.sdp_sent, session->stats.sdp_received,
+        session->stats.ice_sent, session->stats.ice_received);
+    if (session->stats.ice_frames_sent != session->stats.ice_sent)
+        g_print("[sender] Session '%s' sent %u local candidates in %u frames\n",
+            session->id, session->stats.ice_sent, session->stats.ice_frames_sent);
+    g_print("[sender] Session '%s' signaling %" G_GSIZE_FORMAT "/%" G_GSIZE_FORMAT
+        " payload bytes tx/rx, %.2f ms in send (%s)\n",
+        session->id, session->stats.bytes_sent, session->stats.bytes_received,
+        session->stats.send_us / 1000.0, ws_deflate ? "permessage-deflate" : "uncompressed");
+
+    if (session->tee_pad) {
+        GstPad* qsink = gst_element_get_static_pad(session->queue, "sink");
+        gst_pad_unlink(session->tee_pad, qsink);
+        gst_object_unref(qsink);
+        gst_element_release_request_pad(tee, session->tee_pad);
+        gst_object_unref(session->tee_pad);
+    }
+
+    if (session->gccbwe) {
+        g_signal_handlers_disconnect_by_data(session->gccbwe, session);
+        gst_object_unref(session->gccbwe);
+    }
+
+    if (session->webrtc) {
+        g_signal_handlers_disconnect_by_data(session->webrtc, session);
+        gst_element_set_state(session->webrtc, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(pipep), session->webrtc);
+    }
+
+    if (session->queue) {
+        gst_element_set_state(session->queue, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(pipep), session->queue);
+    }
 
-    g_print("[sender] on-negotiation-needed -> create-offer\n");
-    GstPromise* promise = gst_promise_new_with_change_func(on_offer_created, NULL, NULL);
-    g_signal_emit_by_name(webrtc, "create-offer", NULL, promise);
+    g_clear_handle_id(&session->ice_batch_source, g_source_remove);
+    if (session->ice_batch)
+        g_string_free(session->ice_batch, TRUE);
+    g_queue_clear_full(&session->pending_ice, pending_ice_free);
+    g_free(session->id);
+    g_free(session);
+}
+
+static Session*
+add_session(const gchar* peer_id)
+{
+    if (g_hash_table_lookup(sessions, peer_id)) {
+        g_print("[sender] Session '%s' already exists, ignoring join\n", peer_id);
+        return NULL;
+    }
+
+    Session* session = g_new0(Session, 1);
+    session->id = g_strdup(peer_id);
+    session->stats.created_us = g_get_monotonic_time();
+    timeline_init(&session->timeline);
+    timeline_mark_at(&session->timeline, TIMELINE_WS_CONNECTED, ws_connected_us);
+    timeline_mark_at(&session->timeline, TIMELINE_SESSION_CREATED, session->stats.created_us);
+    g_queue_init(&session->pending_ice);
+    if (adaptive_bitrate)
+        bwe_init(&session->bwe, (guint)min_bitrate_kbps, (guint)max_bitrate_kbps, current_kbps);
+    session->queue = gst_element_factory_make("queue", NULL);
+    session->webrtc = gst_element_factory_make("webrtcbin", NULL);
+
+    if (!session->queue || !session->webrtc) {
+        g_printerr("[sender] Failed to create queue/webrtcbin for '%s'\n", peer_id);
+        gst_clear_object(&session->queue);
+        gst_clear_object(&session->webrtc);
+        g_free(session->id);
+        g_free(session);
+        return NULL;
+    }
+
+    /* Bound by time, not buffers: one frame is several RTP packets. A slow
+     * viewer drops its own packets instead of stalling the tee for everyone. */
+    g_object_set(session->queue,
+        "max-size-buffers", 0,
+        "max-size-bytes", 0,
+        "max-size-time", (guint64)(200 * GST_MSECOND),
+        NULL);
+    gst_util_set_object_arg(G_OBJECT(session->queue), "leaky", "downstream");
+
+    g_object_set(session->webrtc,
+        "bundle-policy", GST_WEBRTC_BUNDLE_POLICY_MAX_BUNDLE,
+        "latency", 20,
+        NULL);
+
+    g_signal_connect(session->webrtc, "on-negotiation-needed", G_CALLBACK(on_negotiation_needed), session);
+    g_signal_connect(session->webrtc, "on-ice-candidate", G_CALLBACK(on_ice_candidate), session);
+    g_signal_connect(session->webrtc, "notify::ice-connection-state", G_CALLBACK(on_ice_connection_state), session);
+    g_signal_connect(session->webrtc, "notify::connection-state", G_CALLBACK(on_connection_state), session);
+    if (adaptive_bitrate && use_gccbwe)
+        g_signal_connect(session->webrtc, "request-aux-sender", G_CALLBACK(on_request_aux_sender), session);
+
+    gst_bin_add_many(GST_BIN(pipep), session->queue, session->webrtc, NULL);
+    g_hash_table_insert(sessions, session->id, session);
+
+    GstPad* qsrc = gst_element_get_static_pad(session->queue, "src");
+    GstPad* wsink = gst_element_request_pad_simple(session->webrtc, "sink_%u");
+    GstPadLinkReturn ret = gst_pad_link(qsrc, wsink);
+    gst_pad_add_probe(qsrc, GST_PAD_PROBE_TYPE_BUFFER, on_session_rtp, session, NULL);
+    configure_transceiver(session);
+    gst_object_unref(qsrc);
+    gst_object_unref(wsink);
+
+    if (ret != GST_PAD_LINK_OK) {
+        g_printerr("[sender] Failed to link queue -> webrtcbin for '%s' (ret=%d)\n", peer_id, ret);
+        g_hash_table_remove(sessions, peer_id);
+        return NULL;
+    }
+
+    gst_element_sync_state_with_parent(session->webrtc);
+    gst_element_sync_state_with_parent(session->queue);
+
+    session->tee_pad = gst_element_request_pad_simple(tee, "src_%u");
+    GstPad* qsink = gst_element_get_static_pad(session->queue, "sink");
+    ret = gst_pad_link(session->tee_pad, qsink);
+    gst_object_unref(qsink);
+
+    if (ret != GST_PAD_LINK_OK) {
+        g_printerr("[sender] Failed to link tee -> queue for '%s' (ret=%d)\n", peer_id, ret);
+        g_hash_table_remove(sessions, peer_id);
+        return NULL;
+    }
+
+    g_print("[sender] Session '%s' added (%u active)\n", peer_id, g_hash_table_size(sessions));
+    return session;
+}
+
+static void
+remove_session(const gchar* peer_id)
+{
+    if (g_hash_table_remove(sessions, peer_id)) {
+        /* Whatever it still had queued is for a peer connection that is gone */
+        signaling_queue_drop_peer(&tx_queue, peer_id);
+        g_print("[sender] Session '%s' removed (%u active)\n", peer_id, g_hash_table_size(sessions));
+    }
+}
+
+/*
+ * The relay announces a leave when the peer's signaling drops, and a peer
+ * that comes back gets a new id. Media that is still connected is kept
+ * until the peer connection ends (reap_left_session()); only sessions
+ * without live media go right away.
+ */
+static void
+leave_session(const gchar* peer_id)
+{
+    Session* session = g_hash_table_lookup(sessions, peer_id);
+    GstWebRTCPeerConnectionState state = GST_WEBRTC_PEER_CONNECTION_STATE_CLOSED;
+    if (session)
+        g_object_get(session->webrtc, "connection-state", &state, NULL);
+    if (state != GST_WEBRTC_PEER_CONNECTION_STATE_CONNECTED) {
+        remove_session(peer_id);
+        return;
+    }
+
+    session->peer_left = TRUE;
+    g_print("[sender] '%s' left signaling, keeping its media until the connection ends\n", peer_id);
 }
 
 /* ---------- Parse incoming messages (we ignore offers, we only accept answer + ICE) ---------- */
@@ -174,67 +1319,196 @@ handle_server_message(SoupWebsocketConnection* conn, SoupWebsocketDataType type,
     (void)conn;
     (void)user_data;
 
-    if (type != SOUP_WEBSOCKET_DATA_TEXT)
-        return;
-
     gsize size = 0;
     const gchar* data = g_bytes_get_data(message, &size);
-    gchar* text = g_strndup(data, size);
 
-    JsonParser* parser = json_parser_new();
-    if (!json_parser_load_from_data(parser, text, -1, NULL)) {
-        g_object_unref(parser);
-        g_free(text);
+    /* Both forms are parsed in place; parser is only set for the json-glib fallback */
+    SignalingMessage msg;
+    JsonParser* parser = NULL;
+    if (type == SOUP_WEBSOCKET_DATA_BINARY) {
+        if (!signaling_parse_binary(data, size, &msg))
+            return;
+    }
+    else if (!signaling_parse_text(data, size, &msg, &parser)) {
         return;
     }
 
-    JsonNode* root = json_parser_get_root(parser);
-    if (!JSON_NODE_HOLDS_OBJECT(root)) {
-        g_object_unref(parser);
-        g_free(text);
+    const gchar* peer_id = signaling_span_str(&msg.peer, rx_peer);
+
+    /* Viewers join/leave only matter in fan-out mode */
+    if (msg.type == SIGNALING_MSG_JOIN) {
+        /* After a reconnect the server re-announces viewers we still serve */
+        if (fanout && peer_id[0] && !g_hash_table_contains(sessions, peer_id))
+            add_session(peer_id);
+        g_clear_object(&parser);
+        return;
+    }
+    if (msg.type == SIGNALING_MSG_LEAVE) {
+        if (fanout)
+            leave_session(peer_id);
+        g_clear_object(&parser);
         return;
     }
 
-    JsonObject* obj = json_node_get_object(root);
+    if (!fanout)
+        peer_id = "";
 
-    /* SDP? */
-    if (json_object_has_member(obj, "sdp")) {
-        JsonObject* sdpobj = json_object_get_object_member(obj, "sdp");
-        const gchar* sdptype = json_object_get_string_member(sdpobj, "type");
-        const gchar* sdptext = json_object_get_string_member(sdpobj, "sdp");
+    Session* session = g_hash_table_lookup(sessions, peer_id);
+    if (!session) {
+        g_print("[sender] Message for unknown session '%s', ignoring\n", peer_id);
+        g_clear_object(&parser);
+        return;
+    }
+    session->stats.bytes_received += size;
 
+    /* SDP? */
+    if (msg.type == SIGNALING_MSG_SDP) {
         /* Sender expects ANSWER */
-        if (g_strcmp0(sdptype, "answer") == 0) {
+        if (signaling_span_equal(&msg.sdp_type, "answer") && session->state == NEGOTIATION_OFFER_SENT) {
+            const gchar* sdptext = signaling_span_str(&msg.sdp, rx_text);
+
             GstSDPMessage* sdp = NULL;
             gst_sdp_message_new(&sdp);
-            gst_sdp_message_parse_buffer((guint8*)sdptext, strlen(sdptext), sdp);
+            gst_sdp_message_parse_buffer((guint8*)sdptext, rx_text->len, sdp);
 
             GstWebRTCSessionDescription* answer =
                 gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_ANSWER, sdp);
 
-            g_print("[sender] Received SDP answer -> set-remote-description\n");
-            GstPromise* p = gst_promise_new();
-            g_signal_emit_by_name(webrtc, "set-remote-description", answer, p);
-            gst_promise_interrupt(p);
-            gst_promise_unref(p);
+            g_print("[sender] Received SDP answer from '%s' -> set-remote-description\n", session->id);
+            GstPromise* p = gst_promise_new_with_change_func(on_answer_set, g_strdup(session->id), g_free);
+            g_signal_emit_by_name(session->webrtc, "set-remote-description", answer, p);
 
             gst_webrtc_session_description_free(answer);
+
+            /* webrtcbin runs its operations in order, so candidates queued
+             * behind set-remote-description see the answer applied */
+            session->stats.sdp_received++;
+            session->state = NEGOTIATION_STABLE;
+            session_flush_pending_ice(session);
         }
     }
     /* ICE? */
-    else if (json_object_has_member(obj, "ice")) {
-        JsonObject* ice = json_object_get_object_member(obj, "ice");
-        const gchar* candidate = json_object_get_string_member(ice, "candidate");
-        gint mline = json_object_get_int_member(ice, "sdpMLineIndex");
+    else if (msg.type == SIGNALING_MSG_ICE) {
+        for (guint i = 0; i < msg.n_ice; i++)
+            session_add_remote_ice(session, msg.ice[i].mlineindex, signaling_span_str(&msg.ice[i].candidate, rx_text));
+        if (msg.n_ice_dropped)
+            g_printerr("[sender] '%s' batched %u candidates past the limit of %d, dropped\n",
+                session->id, msg.n_ice_dropped, SIGNALING_ICE_BATCH_MAX);
+    }
+
+    g_clear_object(&parser);
+}
+
+/* ---------- Glass-to-glass stamps (--stamp-frames) ---------- */
+/* Streaming thread: the buffer's PTS is the key, wall clock the capture time */
+static GstPadProbeReturn
+on_captured(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    (void)pad;
+    (void)user_data;
+
+    latency_stamp_map_put(capture_times, GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info)),
+        g_get_real_time());
+    return GST_PAD_PROBE_OK;
+}
 
-        g_signal_emit_by_name(webrtc, "add-ice-candidate", mline, candidate);
+/* Encoder and payloader keep the PTS, so every packet finds its frame */
+static gboolean
+stamp_rtp_packet(GstBuffer** buffer, guint idx, gpointer user_data)
+{
+    (void)idx;
+    (void)user_data;
+
+    gint64 capture_us;
+    if (latency_stamp_map_lookup(capture_times, GST_BUFFER_PTS(*buffer), &capture_us))
+        latency_stamp_write(buffer, capture_us);
+    return TRUE;
+}
+
+static GstPadProbeReturn
+on_payloaded(GstPad* pad, GstPadProbeInfo* info, gpointer user_data)
+{
+    (void)pad;
+    (void)user_data;
+
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList* list = gst_buffer_list_make_writable(GST_PAD_PROBE_INFO_BUFFER_LIST(info));
+        gst_buffer_list_foreach(list, stamp_rtp_packet, NULL);
+        GST_PAD_PROBE_INFO_DATA(info) = list;
     }
+    else {
+        GstBuffer* buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        stamp_rtp_packet(&buffer, 0, NULL);
+        GST_PAD_PROBE_INFO_DATA(info) = buffer;
+    }
+    return GST_PAD_PROBE_OK;
+}
 
-    g_object_unref(parser);
-    g_free(text);
+static gboolean
+add_stamp_probe(const gchar* element_name, GstPadProbeType type, GstPadProbeCallback callback)
+{
+    GstElement* element = gst_bin_get_by_name(GST_BIN(pipep), element_name);
+    if (!element) {
+        g_printerr("[sender] Failed to get '%s' for --stamp-frames\n", element_name);
+        return FALSE;
+    }
+
+    GstPad* src = gst_element_get_static_pad(element, "src");
+    gst_pad_add_probe(src, type, callback, NULL, NULL);
+    gst_object_unref(src);
+    gst_object_unref(element);
+    return TRUE;
 }
 
 /* ---------- Create sender pipeline ---------- */
+static void
+report_converter(const gchar* name)
+{
+    GstElement* converter = gst_bin_get_by_name(GST_BIN(pipep), name);
+    if (!converter)
+        return;
+
+    convert_report_first_buffer(converter, "[sender]");
+    gst_object_unref(converter);
+}
+
+/* Whether the device cannot deliver the encoder's input format itself */
+static gboolean
+capture_needs_convert(void)
+{
+    return !capture_backend_supports(capture_backend, source_device,
+        encoder_backend_input_format(encoder_backend), CAPTURE_WIDTH, CAPTURE_HEIGHT, CAPTURE_FPS);
+}
+
+/*
+ * Capture up to the raw frames the encoder takes: source ! caps ! queue and,
+ * only when capture_needs_convert(), videoconvert with convert_n_threads.
+ * Ends without a trailing "!".
+ */
+static gchar*
+describe_capture(gboolean convert, guint convert_n_threads)
+{
+    const gchar* format = encoder_backend_input_format(encoder_backend);
+    gchar* src = capture_backend_describe(capture_backend, "camera", source_device, zero_copy);
+
+    gchar* desc = !convert
+        ? g_strdup_printf(
+            "%s ! video/x-raw,format=%s,width=%d,height=%d,framerate=%d/1 ! "
+            "queue max-size-buffers=2 max-size-time=0 max-size-bytes=0 leaky=downstream",
+            src, format, CAPTURE_WIDTH, CAPTURE_HEIGHT, CAPTURE_FPS)
+        : g_strdup_printf(
+            "%s ! video/x-raw,width=%d,height=%d,framerate=%d/1 ! "
+            "queue max-size-buffers=2 max-size-time=0 max-size-bytes=0 leaky=downstream ! "
+            "videoconvert name=convert n-threads=%u ! video/x-raw,format=%s",
+            src, CAPTURE_WIDTH, CAPTURE_HEIGHT, CAPTURE_FPS, convert_n_threads, format);
+
+    g_print("[sender] capture: %s%s, %s\n", capture_backend_name(capture_backend),
+        zero_copy ? " (zero-copy)" : "",
+        convert ? "videoconvert" : "native format, no conversion");
+    g_free(src);
+    return desc;
+}
+
 
 
 
@@ -244,20 +1518,50 @@ start_pipeline(void)
 {
     GError* error = NULL;
 
-    /* webrtcbin first, then send RTP into sendrecv. */
-    pipep = gst_parse_launch(
-        "webrtcbin name=sendrecv bundle-policy=max-bundle latency=20 "
-        "mfvideosrc do-timestamp=true ! "
-        "video/x-raw,width=640,height=360,framerate=30/1 ! "
-        "queue max-size-buffers=2 max-size-time=0 max-size-bytes=0 leaky=downstream ! "
-        "videoconvert ! video/x-raw,format=I420 ! "
-        "x264enc tune=zerolatency speed-preset=ultrafast bitrate=1500 "
-        "key-int-max=15 bframes=0 byte-stream=true aud=false ! "
-        "h264parse config-interval=1 ! "
-        "rtph264pay pt=96 config-interval=1 aggregate-mode=zero-latency ! "
-        "application/x-rtp,media=video,encoding-name=H264,payload=96 ! "
-        "sendrecv.",
-        &error);
+    gchar* desc;
+    /* The converters run side by side on the same frames, so they share the
+     * cores: the capture convert plus the simulcast or adaptive scalers */
+    gboolean convert = capture_needs_convert();
+    guint n_converters = (convert ? 1 : 0) +
+        (simulcast ? G_N_ELEMENTS(simulcast_layers) : adaptive_bitrate ? 1 : 0);
+    guint threads = convert_threads(n_converters);
+    gchar* capture = describe_capture(convert, threads);
+    if (simulcast) {
+        gchar* layers = describe_simulcast_layers(threads);
+        desc = g_strdup_printf(
+            "%s ! "
+            "tee name=camtee "
+            "rtpfunnel name=simfunnel ! capsfilter name=simcaps ! "
+            "tee name=videotee allow-not-linked=true"
+            "%s",
+            capture, layers);
+        g_free(layers);
+    }
+    else {
+        gchar* enc = encoder_backend_describe(encoder_backend, "encoder", (guint)bitrate_kbps, (guint)gop_frames);
+        /* --adaptive-bitrate scales down from the capture size as the bitrate drops */
+        gchar* scale = adaptive_bitrate
+            ? g_strdup_printf("videoscale name=scale n-threads=%u ! "
+                "capsfilter name=scalecaps caps=video/x-raw,width=%d,height=%d ! ",
+                threads, CAPTURE_WIDTH, CAPTURE_HEIGHT)
+            : g_strdup("");
+        desc = g_strdup_printf(
+            "%s ! "
+            "%s"
+            "%s ! "
+            "h264parse config-interval=1 ! "
+            "rtph264pay name=pay pt=96 config-interval=1 aggregate-mode=zero-latency ! "
+            RTP_CAPS_H264 " ! "
+            "tee name=videotee allow-not-linked=true",
+            capture, scale, enc);
+        g_free(scale);
+        g_free(enc);
+    }
+
+    /* Encode once; webrtcbins are attached to videotee per session. */
+    pipep = gst_parse_launch(desc, &error);
+    g_free(desc);
+    g_free(capture);
 
     if (error) {
         g_printerr("[sender] Failed to parse pipeline: %s\n", error->message);
@@ -270,35 +1574,152 @@ start_pipeline(void)
         return FALSE;
     }
 
-    webrtc = gst_bin_get_by_name(GST_BIN(pipep), "sendrecv");
-    if (!webrtc) {
-        g_printerr("[sender] Failed to get webrtcbin by name 'sendrecv'\n");
+    tee = gst_bin_get_by_name(GST_BIN(pipep), "videotee");
+    if (!tee) {
+        g_printerr("[sender] Failed to get tee by name 'videotee'\n");
         return FALSE;
     }
 
-    g_object_set(webrtc,
-        "bundle-policy", GST_WEBRTC_BUNDLE_POLICY_MAX_BUNDLE,
-        "latency", 20,
-        NULL);
+    if (stamp_frames) {
+        capture_times = latency_stamp_map_new();
+        if (!add_stamp_probe("camera", GST_PAD_PROBE_TYPE_BUFFER, on_captured) ||
+            !add_stamp_probe(simulcast ? "simfunnel" : "pay",
+                GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST, on_payloaded))
+            return FALSE;
+    }
+
+    if (simulcast && !start_simulcast())
+        return FALSE;
+
+    report_converter("convert");
+    report_converter("scale");
+    for (guint i = 0; simulcast && i < G_N_ELEMENTS(simulcast_layers); i++) {
+        gchar* name = g_strdup_printf("scale_%s", simulcast_layers[i].rid);
+        report_converter(name);
+        g_free(name);
+    }
+
+    if (adaptive_bitrate && !start_adaptive_bitrate())
+        return FALSE;
+
+    if (!simulcast && !add_keyframe_limiter("encoder"))
+        return FALSE;
+    for (guint i = 0; simulcast && i < G_N_ELEMENTS(simulcast_layers); i++) {
+        gchar* name = g_strdup_printf("encoder_%s", simulcast_layers[i].rid);
+        gboolean ok = add_keyframe_limiter(name);
+        g_free(name);
+        if (!ok)
+            return FALSE;
+    }
 
-    g_signal_connect(webrtc, "on-negotiation-needed", G_CALLBACK(on_negotiation_needed), NULL);
-    g_signal_connect(webrtc, "on-ice-candidate", G_CALLBACK(send_ice_candidate), NULL);
+    sessions = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, session_free);
 
     if (gst_element_set_state(pipep, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
         g_printerr("[sender] Failed to set pipeline to PLAYING\n");
         return FALSE;
     }
+    pipeline_started_us = g_get_monotonic_time();
 
-    g_print("[sender] pipeline started (VP8)\n");
+    /* Single-viewer mode: one untagged session right away */
+    if (!fanout && !add_session(""))
+        return FALSE;
+
+    g_print("[sender] pipeline started (H.264 via %s, %d kbit/s%s%s)\n",
+        encoder_backend_factory(encoder_backend), bitrate_kbps,
+        simulcast ? ", simulcast f/h/q" : "", fanout ? ", fan-out" : "");
     return TRUE;
 }
 /* ---------- WebSocket connect ---------- */
+static void connect_to_server_async(void);
+
+static gboolean
+on_reconnect_timeout(gpointer user_data)
+{
+    (void)user_data;
+    reconnect_source = 0;
+    connect_to_server_async();
+    return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_reconnect(void)
+{
+    guint delay_ms = backoff_next_ms(&reconnect_backoff);
+    g_print("[sender] Reconnecting to signaling in %u ms (media keeps running)\n", delay_ms);
+    reconnect_source = g_timeout_add(delay_ms, on_reconnect_timeout, NULL);
+}
+
+/* Still connected, or answered and still connecting: leave it alone */
+static gboolean
+session_media_alive(Session* session)
+{
+    GstWebRTCPeerConnectionState state;
+    g_object_get(session->webrtc, "connection-state", &state, NULL);
+
+    if (state == GST_WEBRTC_PEER_CONNECTION_STATE_CONNECTED)
+        return TRUE;
+    return session->state == NEGOTIATION_STABLE &&
+        (state == GST_WEBRTC_PEER_CONNECTION_STATE_NEW ||
+         state == GST_WEBRTC_PEER_CONNECTION_STATE_CONNECTING);
+}
+
+/*
+ * Back on signaling after an outage. Live sessions just move to the new
+ * connection. A dead one (ICE failed, or its offer/answer was lost in the
+ * outage) gets a fresh webrtcbin, which is a new ICE agent and DTLS
+ * handshake while capture and encoder keep running: webrtcbin cannot
+ * restart ICE in place. In fan-out mode dead sessions are dropped and come
+ * back through the server's join announcements, so viewers that left while
+ * we were away are not offered to.
+ */
+static void
+resume_sessions(void)
+{
+    GPtrArray* dead = g_ptr_array_new_with_free_func(g_free);
+    guint kept = 0;
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, sessions);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        Session* session = value;
+        if (session_media_alive(session))
+            kept++;
+        else
+            g_ptr_array_add(dead, g_strdup(session->id));
+    }
+
+    for (guint i = 0; i < dead->len; i++) {
+        const gchar* peer_id = g_ptr_array_index(dead, i);
+        remove_session(peer_id);
+        if (!fanout)
+            add_session(peer_id);
+    }
+
+    g_print("[sender] Signaling resumed: %u sessions kept, %u restarted\n", kept, dead->len);
+    g_ptr_array_unref(dead);
+}
+
 static void
 on_server_closed(SoupWebsocketConnection* conn, gpointer user_data)
 {
-    (void)conn;
     (void)user_data;
-    cleanup_and_quit("[sender] Server closed");
+
+    /* Before the first connection there is nothing to keep alive */
+    if (!reconnect || !loop || !pipep) {
+        cleanup_and_quit("[sender] Server closed");
+        return;
+    }
+
+    g_signal_handlers_disconnect_by_func(conn, handle_server_message, NULL);
+    g_signal_handlers_disconnect_by_func(conn, on_server_closed, NULL);
+    if (conn == ws_conn)
+        g_clear_object(&ws_conn);
+
+    /* Frames produced during the outage wait for the next connection */
+    signaling_queue_set_connection(&tx_queue, NULL);
+    g_print("[sender] Signaling queue: %s\n", signaling_queue_write_report(&tx_queue, tx_text));
+    schedule_reconnect();
 }
 
 static void
@@ -311,17 +1732,48 @@ on_server_connected(SoupSession* session, GAsyncResult* res, SoupMessage* msg)
     if (error) {
         g_printerr("WS connect failed: %s\n", error->message);
         g_error_free(error);
-        cleanup_and_quit("[sender] WS connect failed");
+        /* Redial only once signaling has been up; --early-start alone is not enough */
+        if (reconnect && ws_connected_us)
+            schedule_reconnect();
+        else
+            cleanup_and_quit("[sender] WS connect failed");
         return;
     }
-
-    g_print("[sender] Connected to signaling server\n");
+    gboolean resuming = ws_connected_us != 0;
+    ws_connected_us = g_get_monotonic_time();
+    ws_deflate = conn_is_deflated(ws_conn);
+    backoff_reset(&reconnect_backoff);
+
+    g_print("[sender] Connected to signaling server (%s signaling%s)\n",
+        conn_is_binary(ws_conn) ? "binary" : "JSON", ws_deflate ? ", permessage-deflate" : "");
+    if (compress_signaling && !ws_deflate)
+        g_print("[sender] Server declined permessage-deflate, signaling is uncompressed\n");
     g_signal_connect(ws_conn, "message", G_CALLBACK(handle_server_message), NULL);
     g_signal_connect(ws_conn, "closed", G_CALLBACK(on_server_closed), NULL);
 
+    if (resuming) {
+        resume_sessions();
+    }
+    else if (pipep) {
+        /* --early-start: the session (and its offer) predate the connection */
+        GHashTableIter iter;
+        gpointer value;
+        g_hash_table_iter_init(&iter, sessions);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            Session* session = value;
+            timeline_mark_at(&session->timeline, TIMELINE_WS_CONNECTED, ws_connected_us);
+        }
+        g_print("[sender] Signaling up %.1f ms after the pipeline started\n",
+            (ws_connected_us - pipeline_started_us) / 1000.0);
+    }
     /* Start media after WS is up (simple + predictable) */
-    if (!start_pipeline())
+    else if (!start_pipeline()) {
         cleanup_and_quit("[sender] Failed to start pipeline");
+        return;
+    }
+
+    /* Only now, so frames queued by sessions resume_sessions() dropped are gone */
+    signaling_queue_set_connection(&tx_queue, ws_conn);
 }
 
 static gboolean
@@ -353,6 +1805,12 @@ connect_to_server_async(void)
     SoupSession* session = soup_session_new();
     SoupMessage* message = soup_message_new(SOUP_METHOD_GET, server_url);
 
+    /* libsoup offers permessage-deflate by default; keep it opt-in */
+    if (!compress_signaling)
+        soup_session_remove_feature_by_type(session, SOUP_TYPE_WEBSOCKET_EXTENSION_DEFLATE);
+    else if (!soup_session_has_feature(session, SOUP_TYPE_WEBSOCKET_EXTENSION_MANAGER))
+        soup_session_add_feature_by_type(session, SOUP_TYPE_WEBSOCKET_EXTENSION_MANAGER);
+
     if (!message) {
         cleanup_and_quit("[sender] Failed to create SoupMessage");
         return;
@@ -365,11 +1823,13 @@ connect_to_server_async(void)
 
     g_print("[sender] Connecting to %s ...\n", server_url);
 
+    static gchar* protocols[] = { SIGNALING_PROTOCOL_BINARY, SIGNALING_PROTOCOL_JSON, NULL };
+
     soup_session_websocket_connect_async(
         session,
         message,
         NULL,                    /* origin */
-        NULL,                    /* protocols */
+        binary_signaling ? protocols : NULL,
         G_PRIORITY_DEFAULT,      /* io_priority */
         NULL,                    /* cancellable */
         (GAsyncReadyCallback)on_server_connected,
@@ -381,6 +1841,26 @@ connect_to_server_async(void)
 static GOptionEntry entries[] = {
   {"server", 0, 0, G_OPTION_ARG_STRING, &server_url, "Signaling server URL (wss://...)", "URL"},
   {"disable-ssl", 0, 0, G_OPTION_ARG_NONE, &disable_ssl, "Disable TLS cert checks (useful for self-signed)", NULL},
+  {"ice-batch-ms", 0, 0, G_OPTION_ARG_INT, &ice_batch_ms, "Coalesce local ICE candidates gathered within MS into one message (0 = off)", "MS"},
+  {"binary-signaling", 0, 0, G_OPTION_ARG_NONE, &binary_signaling, "Offer the binary signaling subprotocol (falls back to JSON)", NULL},
+  {"compress-signaling", 0, 0, G_OPTION_ARG_NONE, &compress_signaling, "Offer permessage-deflate on the signaling connection", NULL},
+  {"no-reconnect", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &reconnect, "Quit when the signaling connection drops instead of redialling", NULL},
+  {"fanout", 0, 0, G_OPTION_ARG_NONE, &fanout, "Encode once and serve every viewer that joins via signaling", NULL},
+  {"early-start", 0, 0, G_OPTION_ARG_NONE, &early_start, "Start capture and encoder while signaling connects; the offer goes out once it is up", NULL},
+  {"source", 0, 0, G_OPTION_ARG_STRING, &source_name, "Video source: auto, mf, v4l2, pipewire, test, file", "NAME"},
+  {"device", 0, 0, G_OPTION_ARG_STRING, &source_device, "Capture device (v4l2: /dev/videoN, mf: device path, pipewire: node) or file for --source=file", "DEVICE"},
+  {"zero-copy", 0, 0, G_OPTION_ARG_NONE, &zero_copy, "Ask the capture source for dmabuf buffers where supported (v4l2)", NULL},
+  {"encoder", 0, 0, G_OPTION_ARG_STRING, &encoder_name, "H.264 encoder: auto, nvenc, qsv, mf, va, vaapi, v4l2, openh264, x264", "NAME"},
+  {"bitrate", 0, 0, G_OPTION_ARG_INT, &bitrate_kbps, "Encoder bitrate in kbit/s", "KBPS"},
+  {"gop", 0, 0, G_OPTION_ARG_INT, &gop_frames, "Keyframe interval in frames (viewers' PLIs add keyframes on demand)", "FRAMES"},
+  {"nack", 0, 0, G_OPTION_ARG_NONE, &nack, "Retransmit lost packets (RTX) when viewers NACK them", NULL},
+  {"fec", 0, 0, G_OPTION_ARG_INT, &fec_percentage, "Add ULPFEC/RED at this percentage of the bitrate (0 = off)", "PERCENT"},
+  {"pli-interval", 0, 0, G_OPTION_ARG_INT, &pli_interval_ms, "Shortest gap between keyframes forced by viewers' PLIs", "MS"},
+  {"adaptive-bitrate", 0, 0, G_OPTION_ARG_NONE, &adaptive_bitrate, "Retarget bitrate and resolution from bandwidth estimates (rtpgccbwe if installed, else RTCP)", NULL},
+  {"min-bitrate", 0, 0, G_OPTION_ARG_INT, &min_bitrate_kbps, "Lowest bitrate --adaptive-bitrate goes to, kbit/s", "KBPS"},
+  {"max-bitrate", 0, 0, G_OPTION_ARG_INT, &max_bitrate_kbps, "Highest bitrate --adaptive-bitrate goes to, kbit/s (default: --bitrate)", "KBPS"},
+  {"simulcast", 0, 0, G_OPTION_ARG_NONE, &simulcast, "Encode full/half/quarter resolution layers and offer them as RIDs f;h;q", NULL},
+  {"stamp-frames", 0, 0, G_OPTION_ARG_NONE, &stamp_frames, "Carry capture time in an RTP header extension (for receiver --measure-latency)", NULL},
   {NULL}
 };
 
@@ -398,8 +1878,76 @@ main(int argc, char* argv[])
         return 1;
     }
 
+    encoder_backend = g_strcmp0(encoder_name, "auto") == 0
+        ? encoder_backend_probe()
+        : encoder_backend_find(encoder_name);
+    if (!encoder_backend) {
+        gchar* names = encoder_backend_list_names();
+        g_printerr("[sender] No usable H.264 encoder for '%s' (known: %s)\n", encoder_name, names);
+        g_free(names);
+        return 1;
+    }
+
+    capture_backend = g_strcmp0(source_name, "auto") == 0
+        ? capture_backend_probe(source_device)
+        : capture_backend_find(source_name);
+    if (!capture_backend) {
+        gchar* names = capture_backend_list_names();
+        g_printerr("[sender] No usable video source for '%s' (known: %s)\n", source_name, names);
+        g_free(names);
+        return 1;
+    }
+
+    if (capture_backend_needs_device(capture_backend) && !source_device) {
+        g_printerr("[sender] --source=%s needs --device\n", capture_backend_name(capture_backend));
+        return 1;
+    }
+
+    /* One encoder to retarget; per-layer adaptation is the SFU's job */
+    if (simulcast && adaptive_bitrate) {
+        g_printerr("[sender] --simulcast and --adaptive-bitrate cannot be combined\n");
+        return 1;
+    }
+
+    if (fec_percentage < 0 || fec_percentage > 100 || pli_interval_ms < 0) {
+        g_printerr("[sender] --fec takes 0..100 and --pli-interval a non-negative value\n");
+        return 1;
+    }
+
+    if (bitrate_kbps <= 0 || max_bitrate_kbps < 0) {
+        g_printerr("[sender] --bitrate and --max-bitrate take positive values\n");
+        return 1;
+    }
+    if (max_bitrate_kbps == 0)
+        max_bitrate_kbps = bitrate_kbps;
+    /* Unsigned casts and CLAMP in the estimator assume 0 < min <= max */
+    if (adaptive_bitrate && (min_bitrate_kbps <= 0 || min_bitrate_kbps > max_bitrate_kbps)) {
+        g_printerr("[sender] --min-bitrate must be positive and at most --max-bitrate (%d)\n",
+            max_bitrate_kbps);
+        return 1;
+    }
+    if (adaptive_bitrate) {
+        GstElementFactory* gcc = gst_element_factory_find("rtpgccbwe");
+        use_gccbwe = gcc != NULL;
+        gst_clear_object(&gcc);
+    }
+
+    backoff_init(&reconnect_backoff, RECONNECT_BASE_MS, RECONNECT_MAX_MS);
+
+    rx_peer = g_string_sized_new(64);
+    rx_text = g_string_sized_new(4096);
+    tx_text = g_string_sized_new(4096);
+    signaling_queue_init(&tx_queue);
+    signaling_queue_set_sent_func(&tx_queue, on_frame_sent, NULL);
+
     loop = g_main_loop_new(NULL, FALSE);
 
+    /* Camera open and encoder init overlap DNS, TCP, TLS and the WS handshake */
+    if (early_start && !start_pipeline()) {
+        cleanup_and_quit("[sender] Failed to start pipeline");
+        return 1;
+    }
+
     connect_to_server_async();
     g_main_loop_run(loop);
 
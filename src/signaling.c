@@ -0,0 +1,874 @@
+/*
+ * signaling.c — see signaling.h.
+ */
+
+#include "signaling.h"
+
+#include <string.h>
+
+/* ---------- In-place scanner ---------- */
+typedef struct {
+    const gchar* p;
+    const gchar* end;
+} Scanner;
+
+#define SCAN_MAX_DEPTH 32
+
+static void
+scan_ws(Scanner* s)
+{
+    while (s->p < s->end && (*s->p == ' ' || *s->p == '\t' || *s->p == '\n' || *s->p == '\r'))
+        s->p++;
+}
+
+static gboolean
+scan_char(Scanner* s, gchar c)
+{
+    scan_ws(s);
+    if (s->p >= s->end || *s->p != c)
+        return FALSE;
+    s->p++;
+    return TRUE;
+}
+
+static gboolean
+scan_peek(Scanner* s, gchar c)
+{
+    scan_ws(s);
+    return s->p < s->end && *s->p == c;
+}
+
+static gint
+hex_value(gchar c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static gboolean
+read_hex4(const gchar* p, const gchar* end, guint* out)
+{
+    guint v = 0;
+
+    if (end - p < 4)
+        return FALSE;
+    for (gint i = 0; i < 4; i++) {
+        gint h = hex_value(p[i]);
+        if (h < 0)
+            return FALSE;
+        v = (v << 4) | (guint)h;
+    }
+    *out = v;
+    return TRUE;
+}
+
+/* After "\u": four hex digits, not NUL, and a surrogate only as a high/low
+ * pair, so signaling_span_str() always yields a C string of valid UTF-8 */
+static gboolean
+scan_unicode_escape(Scanner* s)
+{
+    guint cp, lo;
+
+    if (!read_hex4(s->p, s->end, &cp) || cp == 0 || (cp >= 0xDC00 && cp <= 0xDFFF))
+        return FALSE;
+    s->p += 4;
+    if (cp < 0xD800 || cp > 0xDBFF)
+        return TRUE;
+
+    if (s->end - s->p < 6 || s->p[0] != '\\' || s->p[1] != 'u' ||
+        !read_hex4(s->p + 2, s->end, &lo) || lo < 0xDC00 || lo > 0xDFFF)
+        return FALSE;
+    s->p += 6;
+    return TRUE;
+}
+
+static gboolean
+scan_string(Scanner* s, SignalingSpan* out)
+{
+    if (!scan_char(s, '"'))
+        return FALSE;
+
+    const gchar* start = s->p;
+    gboolean escaped = FALSE;
+
+    while (s->p < s->end) {
+        guchar c = (guchar)*s->p;
+        if (c == '"') {
+            out->data = start;
+            out->len = (gsize)(s->p - start);
+            out->escaped = escaped;
+            s->p++;
+            return TRUE;
+        }
+        if (c < 0x20)
+            return FALSE;
+        if (c == '\\') {
+            escaped = TRUE;
+            s->p++;
+            if (s->p >= s->end)
+                return FALSE;
+            c = (guchar)*s->p++;
+            if (c == 'u') {
+                if (!scan_unicode_escape(s))
+                    return FALSE;
+            }
+            else if (c == '\0' || !strchr("\"\\/bfnrt", c)) {
+                return FALSE;
+            }
+            continue;
+        }
+        s->p++;
+    }
+    return FALSE;
+}
+
+static gboolean
+scan_uint(Scanner* s, guint* out)
+{
+    scan_ws(s);
+    guint64 v = 0;
+    const gchar* start = s->p;
+
+    while (s->p < s->end && *s->p >= '0' && *s->p <= '9') {
+        v = v * 10 + (guint)(*s->p - '0');
+        if (v > G_MAXUINT)
+            return FALSE;
+        s->p++;
+    }
+    /* Fractions, exponents and signs are legal JSON but not an m-line index */
+    if (s->p == start || (s->p < s->end && (*s->p == '.' || *s->p == 'e' || *s->p == 'E')))
+        return FALSE;
+
+    *out = (guint)v;
+    return TRUE;
+}
+
+static gboolean
+scan_literal(Scanner* s, const gchar* lit)
+{
+    gsize n = strlen(lit);
+    if ((gsize)(s->end - s->p) < n || memcmp(s->p, lit, n) != 0)
+        return FALSE;
+    s->p += n;
+    return TRUE;
+}
+
+static gboolean
+scan_skip_value(Scanner* s, guint depth)
+{
+    SignalingSpan ignored;
+
+    if (depth > SCAN_MAX_DEPTH)
+        return FALSE;
+
+    scan_ws(s);
+    if (s->p >= s->end)
+        return FALSE;
+
+    switch (*s->p) {
+    case '"':
+        return scan_string(s, &ignored);
+    case '{':
+        s->p++;
+        if (scan_char(s, '}'))
+            return TRUE;
+        do {
+            if (!scan_string(s, &ignored) || !scan_char(s, ':') || !scan_skip_value(s, depth + 1))
+                return FALSE;
+        } while (scan_char(s, ','));
+        return scan_char(s, '}');
+    case '[':
+        s->p++;
+        if (scan_char(s, ']'))
+            return TRUE;
+        do {
+            if (!scan_skip_value(s, depth + 1))
+                return FALSE;
+        } while (scan_char(s, ','));
+        return scan_char(s, ']');
+    case 't':
+        return scan_literal(s, "true");
+    case 'f':
+        return scan_literal(s, "false");
+    case 'n':
+        return scan_literal(s, "null");
+    default: {
+        /* Number: good enough to step over, exact syntax is not our business */
+        const gchar* start = s->p;
+        while (s->p < s->end && *s->p && strchr("+-.eE0123456789", *s->p))
+            s->p++;
+        return s->p != start;
+    }
+    }
+}
+
+static gboolean
+key_is(const SignalingSpan* key, const gchar* literal)
+{
+    return !key->escaped && signaling_span_equal(key, literal);
+}
+
+/* {"type":"offer","sdp":"v=0\r\n..."} */
+static gboolean
+scan_sdp_object(Scanner* s, SignalingMessage* msg)
+{
+    gboolean have_type = FALSE, have_sdp = FALSE;
+    SignalingSpan key;
+
+    if (!scan_char(s, '{'))
+        return FALSE;
+    if (scan_char(s, '}'))
+        return FALSE;
+
+    do {
+        if (!scan_string(s, &key) || !scan_char(s, ':'))
+            return FALSE;
+
+        if (key_is(&key, "type") && scan_peek(s, '"')) {
+            if (!scan_string(s, &msg->sdp_type))
+                return FALSE;
+            have_type = TRUE;
+        }
+        else if (key_is(&key, "sdp") && scan_peek(s, '"')) {
+            if (!scan_string(s, &msg->sdp))
+                return FALSE;
+            have_sdp = TRUE;
+        }
+        else if (!scan_skip_value(s, 1)) {
+            return FALSE;
+        }
+    } while (scan_char(s, ','));
+
+    return scan_char(s, '}') && have_type && have_sdp;
+}
+
+/* {"candidate":"candidate:...","sdpMLineIndex":0,"sdpMid":"0"} */
+static gboolean
+scan_ice_object(Scanner* s, SignalingIce* ice)
+{
+    gboolean have_candidate = FALSE;
+    SignalingSpan key;
+
+    ice->mlineindex = 0;
+
+    if (!scan_char(s, '{'))
+        return FALSE;
+    if (scan_char(s, '}'))
+        return FALSE;
+
+    do {
+        if (!scan_string(s, &key) || !scan_char(s, ':'))
+            return FALSE;
+
+        if (key_is(&key, "candidate") && scan_peek(s, '"')) {
+            if (!scan_string(s, &ice->candidate))
+                return FALSE;
+            have_candidate = TRUE;
+        }
+        else if (key_is(&key, "sdpMLineIndex")) {
+            if (!scan_uint(s, &ice->mlineindex))
+                return FALSE;
+        }
+        else if (!scan_skip_value(s, 1)) {
+            return FALSE;
+        }
+    } while (scan_char(s, ','));
+
+    return scan_char(s, '}') && have_candidate;
+}
+
+/* {...} or [{...},{...}] */
+static gboolean
+scan_ice_value(Scanner* s, SignalingMessage* msg)
+{
+    if (!scan_char(s, '[')) {
+        msg->n_ice = 1;
+        return scan_ice_object(s, &msg->ice[0]);
+    }
+
+    msg->n_ice = 0;
+    if (scan_char(s, ']'))
+        return FALSE;
+
+    do {
+        SignalingIce overflow;
+        gboolean keep = msg->n_ice < SIGNALING_ICE_BATCH_MAX;
+
+        if (!scan_ice_object(s, keep ? &msg->ice[msg->n_ice] : &overflow))
+            return FALSE;
+        if (keep)
+            msg->n_ice++;
+        else
+            msg->n_ice_dropped++;
+    } while (scan_char(s, ','));
+
+    return scan_char(s, ']');
+}
+
+gboolean
+signaling_parse_fast(const gchar* data, gsize size, SignalingMessage* msg)
+{
+    Scanner s = { data, data + size };
+    SignalingSpan key;
+    gboolean have_sdp = FALSE, have_ice = FALSE;
+
+    memset(msg, 0, sizeof(*msg));
+
+    if (!scan_char(&s, '{'))
+        return FALSE;
+    if (scan_char(&s, '}'))
+        return FALSE;
+
+    do {
+        if (!scan_string(&s, &key) || !scan_char(&s, ':'))
+            return FALSE;
+
+        if (key_is(&key, "sdp")) {
+            if (!scan_sdp_object(&s, msg))
+                return FALSE;
+            have_sdp = TRUE;
+        }
+        else if (key_is(&key, "ice")) {
+            if (!scan_ice_value(&s, msg))
+                return FALSE;
+            have_ice = TRUE;
+        }
+        else if (key_is(&key, "peer")) {
+            if (!scan_string(&s, &msg->peer))
+                return FALSE;
+        }
+        else if (key_is(&key, "join") || key_is(&key, "leave")) {
+            if (!scan_string(&s, &msg->peer))
+                return FALSE;
+            msg->type = key_is(&key, "join") ? SIGNALING_MSG_JOIN : SIGNALING_MSG_LEAVE;
+        }
+        else if (!scan_skip_value(&s, 1)) {
+            return FALSE;
+        }
+    } while (scan_char(&s, ','));
+
+    if (!scan_char(&s, '}'))
+        return FALSE;
+    scan_ws(&s);
+    if (s.p != s.end)
+        return FALSE;
+
+    /* Same precedence as the json-glib path: sdp, then ice */
+    if (have_sdp)
+        msg->type = SIGNALING_MSG_SDP;
+    else if (have_ice)
+        msg->type = SIGNALING_MSG_ICE;
+
+    return msg->type != SIGNALING_MSG_UNKNOWN;
+}
+
+/* ---------- json-glib fallback ---------- */
+static void
+span_from_string(SignalingSpan* span, const gchar* str)
+{
+    span->data = str ? str : "";
+    span->len = str ? strlen(str) : 0;
+    span->escaped = FALSE;
+}
+
+static const gchar*
+get_string_member(JsonObject* obj, const gchar* name)
+{
+    JsonNode* node = json_object_get_member(obj, name);
+    if (!node || json_node_get_value_type(node) != G_TYPE_STRING)
+        return NULL;
+    return json_node_get_string(node);
+}
+
+static gboolean
+ice_from_json(JsonNode* node, SignalingIce* ice)
+{
+    if (!JSON_NODE_HOLDS_OBJECT(node))
+        return FALSE;
+    JsonObject* obj = json_node_get_object(node);
+    const gchar* candidate = get_string_member(obj, "candidate");
+    if (!candidate)
+        return FALSE;
+    /* Same rule as the scanner: absent means 0, otherwise an unsigned integer */
+    gint64 mlineindex = 0;
+    JsonNode* index = json_object_get_member(obj, "sdpMLineIndex");
+    if (index) {
+        if (json_node_get_value_type(index) != G_TYPE_INT64)
+            return FALSE;
+        mlineindex = json_node_get_int(index);
+        if (mlineindex < 0 || mlineindex > G_MAXUINT)
+            return FALSE;
+    }
+    span_from_string(&ice->candidate, candidate);
+    ice->mlineindex = (guint)mlineindex;
+    return TRUE;
+}
+
+/* json-glib takes some escapes RFC 8259 does not (and \u0000, which would
+ * cut the string short), so the fallback holds strings to the scanner's rules */
+static gboolean
+strings_valid(const gchar* data, gsize size)
+{
+    Scanner s = { data, data + size };
+    SignalingSpan ignored;
+
+    while (s.p < s.end) {
+        if (*s.p != '"')
+            s.p++;
+        else if (!scan_string(&s, &ignored))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+gboolean
+signaling_parse_json(JsonParser* parser, const gchar* data, gsize size, SignalingMessage* msg)
+{
+    memset(msg, 0, sizeof(*msg));
+
+    if (!strings_valid(data, size))
+        return FALSE;
+
+    if (!json_parser_load_from_data(parser, data, (gssize)size, NULL))
+        return FALSE;
+
+    JsonNode* root = json_parser_get_root(parser);
+    if (!root || !JSON_NODE_HOLDS_OBJECT(root))
+        return FALSE;
+
+    JsonObject* obj = json_node_get_object(root);
+    const gchar* str;
+
+    if ((str = get_string_member(obj, "peer")))
+        span_from_string(&msg->peer, str);
+
+    if (json_object_has_member(obj, "sdp")) {
+        JsonNode* node = json_object_get_member(obj, "sdp");
+        if (!JSON_NODE_HOLDS_OBJECT(node))
+            return FALSE;
+        JsonObject* sdp = json_node_get_object(node);
+        const gchar* type = get_string_member(sdp, "type");
+        const gchar* text = get_string_member(sdp, "sdp");
+        if (!type || !text)
+            return FALSE;
+        span_from_string(&msg->sdp_type, type);
+        span_from_string(&msg->sdp, text);
+        msg->type = SIGNALING_MSG_SDP;
+    }
+    else if (json_object_has_member(obj, "ice")) {
+        JsonNode* node = json_object_get_member(obj, "ice");
+        if (JSON_NODE_HOLDS_ARRAY(node)) {
+            JsonArray* array = json_node_get_array(node);
+            guint n = json_array_get_length(array);
+            if (n == 0)
+                return FALSE;
+            for (guint i = 0; i < n; i++) {
+                SignalingIce overflow;
+                if (!ice_from_json(json_array_get_element(array, i),
+                        i < SIGNALING_ICE_BATCH_MAX ? &msg->ice[i] : &overflow))
+                    return FALSE;
+            }
+            msg->n_ice = MIN(n, SIGNALING_ICE_BATCH_MAX);
+            msg->n_ice_dropped = n - msg->n_ice;
+        }
+        else {
+            if (!ice_from_json(node, &msg->ice[0]))
+                return FALSE;
+            msg->n_ice = 1;
+        }
+        msg->type = SIGNALING_MSG_ICE;
+    }
+    else if ((str = get_string_member(obj, "join"))) {
+        span_from_string(&msg->peer, str);
+        msg->type = SIGNALING_MSG_JOIN;
+    }
+    else if ((str = get_string_member(obj, "leave"))) {
+        span_from_string(&msg->peer, str);
+        msg->type = SIGNALING_MSG_LEAVE;
+    }
+
+    return msg->type != SIGNALING_MSG_UNKNOWN;
+}
+
+gboolean
+signaling_parse_text(const gchar* data, gsize size, SignalingMessage* msg, JsonParser** parser)
+{
+    *parser = NULL;
+
+    if (signaling_parse_fast(data, size, msg))
+        return TRUE;
+
+    JsonParser* p = json_parser_new();
+    if (!signaling_parse_json(p, data, size, msg)) {
+        g_object_unref(p);
+        return FALSE;
+    }
+
+    *parser = p;
+    return TRUE;
+}
+
+/* ---------- Spans ---------- */
+static void
+append_utf8(GString* out, guint cp)
+{
+    gchar buf[4];
+    gsize n;
+
+    if (cp < 0x80) {
+        buf[0] = (gchar)cp;
+        n = 1;
+    }
+    else if (cp < 0x800) {
+        buf[0] = (gchar)(0xC0 | (cp >> 6));
+        buf[1] = (gchar)(0x80 | (cp & 0x3F));
+        n = 2;
+    }
+    else if (cp < 0x10000) {
+        buf[0] = (gchar)(0xE0 | (cp >> 12));
+        buf[1] = (gchar)(0x80 | ((cp >> 6) & 0x3F));
+        buf[2] = (gchar)(0x80 | (cp & 0x3F));
+        n = 3;
+    }
+    else {
+        buf[0] = (gchar)(0xF0 | (cp >> 18));
+        buf[1] = (gchar)(0x80 | ((cp >> 12) & 0x3F));
+        buf[2] = (gchar)(0x80 | ((cp >> 6) & 0x3F));
+        buf[3] = (gchar)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    g_string_append_len(out, buf, (gssize)n);
+}
+
+const gchar*
+signaling_span_str(const SignalingSpan* span, GString* scratch)
+{
+    g_string_truncate(scratch, 0);
+
+    if (!span->escaped) {
+        g_string_append_len(scratch, span->data, (gssize)span->len);
+        return scratch->str;
+    }
+
+    const gchar* p = span->data;
+    const gchar* end = span->data + span->len;
+
+    while (p < end) {
+        const gchar* run = p;
+        while (p < end && *p != '\\')
+            p++;
+        if (p > run)
+            g_string_append_len(scratch, run, p - run);
+        if (p >= end)
+            break;
+
+        /* The scanner only lets valid escapes through */
+        p++;
+        switch (*p++) {
+        case '"':  g_string_append_c(scratch, '"');  break;
+        case '\\': g_string_append_c(scratch, '\\'); break;
+        case '/':  g_string_append_c(scratch, '/');  break;
+        case 'b':  g_string_append_c(scratch, '\b'); break;
+        case 'f':  g_string_append_c(scratch, '\f'); break;
+        case 'n':  g_string_append_c(scratch, '\n'); break;
+        case 'r':  g_string_append_c(scratch, '\r'); break;
+        case 't':  g_string_append_c(scratch, '\t'); break;
+        case 'u': {
+            guint cp, lo;
+            if (!read_hex4(p, end, &cp))
+                break;
+            p += 4;
+            if (cp >= 0xD800 && cp <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u'
+                && read_hex4(p + 2, end, &lo) && lo >= 0xDC00 && lo <= 0xDFFF) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                p += 6;
+            }
+            append_utf8(scratch, cp);
+            break;
+        }
+        default:
+            /* Invalid escape: keep it verbatim rather than guessing */
+            g_string_append_len(scratch, p - 2, 2);
+            break;
+        }
+    }
+
+    return scratch->str;
+}
+
+gboolean
+signaling_span_equal(const SignalingSpan* span, const gchar* literal)
+{
+    gsize n = strlen(literal);
+    return span->len == n && memcmp(span->data, literal, n) == 0;
+}
+
+/* ---------- Writer ---------- */
+static void
+append_escaped(GString* out, const gchar* str)
+{
+    static const gchar hex[] = "0123456789abcdef";
+
+    g_string_append_c(out, '"');
+
+    const gchar* p = str;
+    while (*p) {
+        const gchar* run = p;
+        while ((guchar)*p >= 0x20 && *p != '"' && *p != '\\')
+            p++;
+        if (p > run)
+            g_string_append_len(out, run, p - run);
+        if (!*p)
+            break;
+
+        gchar c = *p++;
+        switch (c) {
+        case '"':  g_string_append_len(out, "\\\"", 2); break;
+        case '\\': g_string_append_len(out, "\\\\", 2); break;
+        case '\b': g_string_append_len(out, "\\b", 2);  break;
+        case '\f': g_string_append_len(out, "\\f", 2);  break;
+        case '\n': g_string_append_len(out, "\\n", 2);  break;
+        case '\r': g_string_append_len(out, "\\r", 2);  break;
+        case '\t': g_string_append_len(out, "\\t", 2);  break;
+        default: {
+            gchar esc[6] = { '\\', 'u', '0', '0', hex[(c >> 4) & 0xF], hex[c & 0xF] };
+            g_string_append_len(out, esc, 6);
+            break;
+        }
+        }
+    }
+
+    g_string_append_c(out, '"');
+}
+
+static const gchar*
+finish_envelope(GString* out, const gchar* peer)
+{
+    if (peer && peer[0]) {
+        g_string_append_len(out, ",\"peer\":", 8);
+        append_escaped(out, peer);
+    }
+    g_string_append_c(out, '}');
+    return out->str;
+}
+
+void
+signaling_append_string(GString* out, const gchar* str)
+{
+    append_escaped(out, str);
+}
+
+void
+signaling_append_ice(GString* out, guint mlineindex, const gchar* candidate)
+{
+    g_string_append_len(out, "{\"candidate\":", 13);
+    append_escaped(out, candidate);
+    g_string_append_printf(out, ",\"sdpMLineIndex\":%u}", mlineindex);
+}
+
+const gchar*
+signaling_write_ice(GString* out, const gchar* peer, guint mlineindex, const gchar* candidate)
+{
+    g_string_truncate(out, 0);
+    g_string_append_len(out, "{\"ice\":", 7);
+    signaling_append_ice(out, mlineindex, candidate);
+    return finish_envelope(out, peer);
+}
+
+const gchar*
+signaling_write_ice_batch(GString* out, const gchar* peer, const GString* items, guint count)
+{
+    g_string_truncate(out, 0);
+    g_string_append_len(out, "{\"ice\":", 7);
+    if (count > 1)
+        g_string_append_c(out, '[');
+    g_string_append_len(out, items->str, (gssize)items->len);
+    if (count > 1)
+        g_string_append_c(out, ']');
+    return finish_envelope(out, peer);
+}
+
+const gchar*
+signaling_write_sdp(GString* out, const gchar* peer, const gchar* type, const gchar* sdp)
+{
+    g_string_truncate(out, 0);
+    g_string_append_len(out, "{\"sdp\":{\"type\":", 15);
+    append_escaped(out, type);
+    g_string_append_len(out, ",\"sdp\":", 7);
+    append_escaped(out, sdp);
+    g_string_append_c(out, '}');
+    return finish_envelope(out, peer);
+}
+
+/* ---------- Binary framing ---------- */
+static void
+append_varint(GString* out, gsize value)
+{
+    while (value >= 0x80) {
+        g_string_append_c(out, (gchar)(0x80 | (value & 0x7F)));
+        value >>= 7;
+    }
+    g_string_append_c(out, (gchar)value);
+}
+
+static gsize
+varint_size(gsize value)
+{
+    gsize n = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static gboolean
+read_varint(const guint8** p, const guint8* end, gsize* out)
+{
+    gsize value = 0;
+
+    for (guint shift = 0; *p < end && shift < 32; shift += 7) {
+        guint8 b = *(*p)++;
+        value |= (gsize)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *out = value;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void
+append_field(GString* out, guint8 tag, const gchar* data, gsize len)
+{
+    g_string_append_c(out, (gchar)tag);
+    append_varint(out, len);
+    g_string_append_len(out, data, (gssize)len);
+}
+
+static void
+begin_binary(GString* out, SignalingMsgType type, const gchar* peer)
+{
+    g_string_truncate(out, 0);
+    g_string_append_c(out, (gchar)type);
+    if (peer && peer[0])
+        append_field(out, SIGNALING_FIELD_PEER, peer, strlen(peer));
+}
+
+void
+signaling_append_ice_binary(GString* out, guint mlineindex, const gchar* candidate)
+{
+    gsize len = strlen(candidate);
+
+    /* value = varint m-line index, then the candidate bytes */
+    g_string_append_c(out, (gchar)SIGNALING_FIELD_ICE);
+    append_varint(out, varint_size(mlineindex) + len);
+    append_varint(out, mlineindex);
+    g_string_append_len(out, candidate, (gssize)len);
+}
+
+void
+signaling_write_ice_binary(GString* out, const gchar* peer, guint mlineindex, const gchar* candidate)
+{
+    begin_binary(out, SIGNALING_MSG_ICE, peer);
+    signaling_append_ice_binary(out, mlineindex, candidate);
+}
+
+void
+signaling_write_ice_batch_binary(GString* out, const gchar* peer, const GString* items)
+{
+    begin_binary(out, SIGNALING_MSG_ICE, peer);
+    g_string_append_len(out, items->str, (gssize)items->len);
+}
+
+void
+signaling_write_sdp_binary(GString* out, const gchar* peer, const gchar* type, const gchar* sdp)
+{
+    begin_binary(out, SIGNALING_MSG_SDP, peer);
+    append_field(out, SIGNALING_FIELD_SDP_TYPE, type, strlen(type));
+    append_field(out, SIGNALING_FIELD_SDP, sdp, strlen(sdp));
+}
+
+/* Binary strings are raw; a NUL inside one would truncate it in
+ * signaling_span_str(), so it is rejected like an escaped \u0000 */
+static gboolean
+span_from_bytes(SignalingSpan* span, const guint8* data, gsize len)
+{
+    if (memchr(data, 0, len))
+        return FALSE;
+    span->data = (const gchar*)data;
+    span->len = len;
+    span->escaped = FALSE;
+    return TRUE;
+}
+
+gboolean
+signaling_parse_binary(const gchar* data, gsize size, SignalingMessage* msg)
+{
+    const guint8* p = (const guint8*)data;
+    const guint8* end = p + size;
+    gboolean have_peer = FALSE, have_type = FALSE, have_sdp = FALSE;
+
+    memset(msg, 0, sizeof(*msg));
+
+    if (p == end)
+        return FALSE;
+    msg->type = (SignalingMsgType)*p++;
+
+    while (p < end) {
+        guint8 tag = *p++;
+        gsize len;
+        if (!read_varint(&p, end, &len) || len > (gsize)(end - p))
+            return FALSE;
+        const guint8* value = p;
+        p += len;
+
+        switch (tag) {
+        case SIGNALING_FIELD_PEER:
+            if (!span_from_bytes(&msg->peer, value, len))
+                return FALSE;
+            have_peer = TRUE;
+            break;
+        case SIGNALING_FIELD_SDP_TYPE:
+            if (!span_from_bytes(&msg->sdp_type, value, len))
+                return FALSE;
+            have_type = TRUE;
+            break;
+        case SIGNALING_FIELD_SDP:
+            if (!span_from_bytes(&msg->sdp, value, len))
+                return FALSE;
+            have_sdp = TRUE;
+            break;
+        case SIGNALING_FIELD_ICE: {
+            const guint8* v = value;
+            gsize mline;
+            if (!read_varint(&v, p, &mline) || mline > G_MAXUINT || memchr(v, 0, (gsize)(p - v)))
+                return FALSE;
+            if (msg->n_ice == SIGNALING_ICE_BATCH_MAX) {
+                msg->n_ice_dropped++;
+                break;
+            }
+            msg->ice[msg->n_ice].mlineindex = (guint)mline;
+            span_from_bytes(&msg->ice[msg->n_ice].candidate, v, (gsize)(p - v));
+            msg->n_ice++;
+            break;
+        }
+        default:
+            /* Unknown fields are skipped so the format can grow */
+            break;
+        }
+    }
+
+    switch (msg->type) {
+    case SIGNALING_MSG_SDP:   return have_type && have_sdp;
+    case SIGNALING_MSG_ICE:   return msg->n_ice > 0;
+    case SIGNALING_MSG_JOIN:
+    case SIGNALING_MSG_LEAVE: return have_peer && msg->peer.len > 0;
+    default:                  return FALSE;
+    }
+}
@@ -0,0 +1,130 @@
+/*
+ * signaling.h — signaling message helpers shared by sender and receiver.
+ *
+ * The hot messages are {"ice":{...}} (or a batch, {"ice":[{...},...]}) and
+ * {"sdp":{...}}, optionally tagged with "peer". signaling_parse_text() scans
+ * them in place (no copy of the frame, no JsonNode tree); anything with
+ * another shape goes through json-glib. signaling_write_*() emit the same
+ * envelopes into a caller-owned, reused buffer.
+ *
+ * The same messages also have a binary form, used when the websocket
+ * negotiates SIGNALING_PROTOCOL_BINARY:
+ *
+ *   u8 SignalingMsgType, then fields of { u8 tag, varint length, bytes }
+ *
+ * Strings are carried raw (no escaping, no NUL). An ICE field's value is the
+ * varint m-line index followed by the candidate; a batch repeats the field.
+ * Lengths and the m-line index are LEB128 varints. Unknown tags are skipped.
+ */
+#ifndef SIGNALING_H
+#define SIGNALING_H
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+/* A string value inside a message buffer. JSON escapes are still in place when
+ * escaped is set; use signaling_span_str() to get a usable C string. */
+typedef struct {
+    const gchar* data;
+    gsize len;
+    gboolean escaped;
+} SignalingSpan;
+
+/* WebSocket subprotocols. Clients that want binary offer both; a server that
+ * picks neither (or predates them) leaves the connection on JSON text. */
+#define SIGNALING_PROTOCOL_BINARY "signaling-bin.v1"
+#define SIGNALING_PROTOCOL_JSON   "signaling-json.v1"
+
+/* Binary field tags */
+enum {
+    SIGNALING_FIELD_PEER = 1,
+    SIGNALING_FIELD_SDP_TYPE = 2,
+    SIGNALING_FIELD_SDP = 3,
+    SIGNALING_FIELD_ICE = 4,
+};
+
+/* Upper bound on candidates in one {"ice":[...]} message, both ways. Parsers
+ * keep the first SIGNALING_ICE_BATCH_MAX of a longer batch and count the rest
+ * in n_ice_dropped. */
+#define SIGNALING_ICE_BATCH_MAX 32
+
+typedef struct {
+    SignalingSpan candidate;
+    guint mlineindex;
+} SignalingIce;
+
+typedef enum {
+    SIGNALING_MSG_UNKNOWN = 0,
+    SIGNALING_MSG_SDP,
+    SIGNALING_MSG_ICE,
+    SIGNALING_MSG_JOIN,     /* peer = id that joined */
+    SIGNALING_MSG_LEAVE,    /* peer = id that left */
+} SignalingMsgType;
+
+typedef struct {
+    SignalingMsgType type;
+    SignalingSpan peer;        /* empty when the message is untagged */
+    SignalingSpan sdp_type;    /* SDP: "offer" / "answer" */
+    SignalingSpan sdp;         /* SDP: session description text */
+    SignalingIce ice[SIGNALING_ICE_BATCH_MAX]; /* ICE: one entry, or one per array element */
+    guint n_ice;
+    guint n_ice_dropped;       /* ICE: well-formed candidates past the cap */
+} SignalingMessage;
+
+/* Parses a text frame into msg. Known shapes are scanned in place and msg
+ * points into data. Other shapes fall back to json-glib; *parser is then set
+ * and owns the strings msg points to, so unref it once msg is handled.
+ * Returns FALSE (and leaves *parser NULL) for unknown or malformed messages. */
+gboolean signaling_parse_text(const gchar* data, gsize size,
+    SignalingMessage* msg, JsonParser** parser);
+
+/* In-place scanner only; FALSE means "not a shape we know", not "invalid". */
+gboolean signaling_parse_fast(const gchar* data, gsize size, SignalingMessage* msg);
+
+/* json-glib path for everything else. */
+gboolean signaling_parse_json(JsonParser* parser, const gchar* data, gsize size,
+    SignalingMessage* msg);
+
+/* Unescapes span into scratch (reused between calls) and returns scratch->str. */
+const gchar* signaling_span_str(const SignalingSpan* span, GString* scratch);
+
+gboolean signaling_span_equal(const SignalingSpan* span, const gchar* literal);
+
+static inline gboolean
+signaling_span_is_empty(const SignalingSpan* span)
+{
+    return span->len == 0;
+}
+
+/* Appends str as a quoted, escaped JSON string. */
+void signaling_append_string(GString* out, const gchar* str);
+
+/* Overwrite out with {"ice":{"candidate":...,"sdpMLineIndex":N}[,"peer":...]}
+ * / {"sdp":{"type":...,"sdp":...}[,"peer":...]} and return out->str. "peer" is
+ * left out when peer is NULL or empty. out keeps its allocation between calls. */
+const gchar* signaling_write_ice(GString* out, const gchar* peer, guint mlineindex,
+    const gchar* candidate);
+
+/* Appends one {"candidate":...,"sdpMLineIndex":N} object (batch building block). */
+void signaling_append_ice(GString* out, guint mlineindex, const gchar* candidate);
+
+/* Overwrite out with an ICE message around count comma-separated objects from
+ * signaling_append_ice(): the plain object form for one, {"ice":[...]} for more. */
+const gchar* signaling_write_ice_batch(GString* out, const gchar* peer,
+    const GString* items, guint count);
+const gchar* signaling_write_sdp(GString* out, const gchar* peer, const gchar* type,
+    const gchar* sdp);
+
+/* Binary counterparts of the writers above; the frame is out->str / out->len.
+ * Batch items come from signaling_append_ice_binary() with no separator. */
+void signaling_write_ice_binary(GString* out, const gchar* peer, guint mlineindex,
+    const gchar* candidate);
+void signaling_append_ice_binary(GString* out, guint mlineindex, const gchar* candidate);
+void signaling_write_ice_batch_binary(GString* out, const gchar* peer, const GString* items);
+void signaling_write_sdp_binary(GString* out, const gchar* peer, const gchar* type,
+    const gchar* sdp);
+
+/* Parses a binary frame; msg points into data. */
+gboolean signaling_parse_binary(const gchar* data, gsize size, SignalingMessage* msg);
+
+#endif /* SIGNALING_H */
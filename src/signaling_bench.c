@@ -0,0 +1,216 @@
+/*
+ * signaling_bench.c — inbound signaling parse throughput (messages/sec).
+ *
+ * Runs the same ICE and SDP frames through
+ *  - the old handle_server_message() path: g_strndup + JsonParser + member lookups
+ *  - signaling_parse_text(): in-place scan + one unescape into a reused buffer
+ *  - signaling_parse_binary(): the same message in the binary subprotocol
+ *
+ *   signaling_bench [--iterations=N]
+ */
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#include <string.h>
+
+#include "signaling.h"
+
+static gint iterations = 200000;
+
+static const gchar* ice_frame =
+    "{\"ice\":{\"candidate\":\"candidate:3 1 UDP 2015363327 192.168.1.23 51234 typ host\","
+    "\"sdpMLineIndex\":0},\"peer\":\"viewer-17\"}";
+
+static const gchar* sdp_lines[] = {
+    "v=0",
+    "o=- 4611731400430051336 2 IN IP4 127.0.0.1",
+    "s=-",
+    "t=0 0",
+    "a=group:BUNDLE video0",
+    "a=ice-options:trickle",
+    "m=video 9 UDP/TLS/RTP/SAVPF 96",
+    "c=IN IP4 0.0.0.0",
+    "a=setup:actpass",
+    "a=ice-ufrag:Kx9sHgS1W4hZlPTq3mCrYw2aJ0uEvNdB",
+    "a=ice-pwd:7CqLmN0pXzR4tV8yB2dF6hJ1kS5wE9gU",
+    "a=rtcp-mux",
+    "a=rtcp-rsize",
+    "a=sendrecv",
+    "a=rtpmap:96 H264/90000",
+    "a=rtcp-fb:96 nack",
+    "a=rtcp-fb:96 nack pli",
+    "a=rtcp-fb:96 ccm fir",
+    "a=fmtp:96 packetization-mode=1;profile-level-id=42c01f;sprop-parameter-sets=Z0LAH9kAUAW7ARAAAAMAEAAAAwPI8YMkgA==,aMuMsg==",
+    "a=ssrc:1460431236 msid:user1280477925@host-5cd9d55c webrtctransceiver0",
+    "a=ssrc:1460431236 cname:user1280477925@host-5cd9d55c",
+    "a=mid:video0",
+    "a=fingerprint:sha-256 9A:3C:52:1E:77:D0:44:8B:AF:06:C1:2E:9D:55:F3:80:4B:62:17:E8:A9:3D:0C:B5:71:FE:26:98:4A:E1:33:5D",
+    NULL
+};
+
+typedef gboolean (*ParseFunc)(const gchar* data, gsize size);
+
+typedef struct {
+    const gchar* data;
+    gsize size;
+} Frame;
+
+/* ---------- Old path (as in handle_server_message before the fast path) ---------- */
+static gboolean
+parse_legacy(const gchar* data, gsize size)
+{
+    gchar* text = g_strndup(data, size);
+    gboolean ok = FALSE;
+
+    JsonParser* parser = json_parser_new();
+    if (json_parser_load_from_data(parser, text, -1, NULL)) {
+        JsonNode* root = json_parser_get_root(parser);
+        if (JSON_NODE_HOLDS_OBJECT(root)) {
+            JsonObject* obj = json_node_get_object(root);
+            if (json_object_has_member(obj, "sdp")) {
+                JsonObject* sdpobj = json_object_get_object_member(obj, "sdp");
+                ok = json_object_get_string_member(sdpobj, "type") != NULL
+                    && json_object_get_string_member(sdpobj, "sdp") != NULL;
+            }
+            else if (json_object_has_member(obj, "ice")) {
+                JsonObject* ice = json_object_get_object_member(obj, "ice");
+                ok = json_object_get_string_member(ice, "candidate") != NULL;
+                (void)json_object_get_int_member(ice, "sdpMLineIndex");
+            }
+        }
+    }
+
+    g_object_unref(parser);
+    g_free(text);
+    return ok;
+}
+
+/* ---------- Fast path ---------- */
+static GString* scratch_peer = NULL;
+static GString* scratch_text = NULL;
+
+static gboolean
+parse_fast(const gchar* data, gsize size)
+{
+    SignalingMessage msg;
+    JsonParser* parser = NULL;
+
+    if (!signaling_parse_text(data, size, &msg, &parser))
+        return FALSE;
+
+    /* What the handlers need as C strings: peer id + candidate or SDP body */
+    signaling_span_str(&msg.peer, scratch_peer);
+    if (msg.type == SIGNALING_MSG_SDP)
+        signaling_span_str(&msg.sdp, scratch_text);
+    else if (msg.type == SIGNALING_MSG_ICE)
+        for (guint i = 0; i < msg.n_ice; i++)
+            signaling_span_str(&msg.ice[i].candidate, scratch_text);
+
+    g_clear_object(&parser);
+    return TRUE;
+}
+
+static gboolean
+parse_binary(const gchar* data, gsize size)
+{
+    SignalingMessage msg;
+
+    if (!signaling_parse_binary(data, size, &msg))
+        return FALSE;
+
+    signaling_span_str(&msg.peer, scratch_peer);
+    if (msg.type == SIGNALING_MSG_SDP)
+        signaling_span_str(&msg.sdp, scratch_text);
+    else if (msg.type == SIGNALING_MSG_ICE)
+        for (guint i = 0; i < msg.n_ice; i++)
+            signaling_span_str(&msg.ice[i].candidate, scratch_text);
+
+    return TRUE;
+}
+
+static gdouble
+run(ParseFunc func, const Frame* frame)
+{
+    const gchar* data = frame->data;
+    gsize size = frame->size;
+
+    if (!func(data, size)) {
+        g_printerr("parser rejected benchmark frame\n");
+        return 0.0;
+    }
+
+    gint64 start = g_get_monotonic_time();
+    for (gint i = 0; i < iterations; i++)
+        func(data, size);
+    gint64 elapsed = MAX(g_get_monotonic_time() - start, 1);
+
+    return iterations * (gdouble)G_USEC_PER_SEC / elapsed;
+}
+
+static void
+report(const gchar* name, const gchar* text, const GString* binary)
+{
+    Frame text_frame = { text, strlen(text) };
+    Frame binary_frame = { binary->str, binary->len };
+
+    gdouble legacy = run(parse_legacy, &text_frame);
+    gdouble fast = run(parse_fast, &text_frame);
+    gdouble bin = run(parse_binary, &binary_frame);
+
+    g_print("%-4s (%4zu B)  json-glib: %10.0f msg/s   fast path: %10.0f msg/s   x%.1f\n",
+        name, text_frame.size, legacy, fast, legacy > 0 ? fast / legacy : 0.0);
+    g_print("%-4s (%4zu B)  binary:    %10.0f msg/s\n", name, binary_frame.size, bin);
+}
+
+static GOptionEntry entries[] = {
+  {"iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Messages per measurement", "N"},
+  {NULL}
+};
+
+int
+main(int argc, char* argv[])
+{
+    GOptionContext* context = g_option_context_new("- signaling parse benchmark");
+    g_option_context_add_main_entries(context, entries, NULL);
+
+    GError* error = NULL;
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("Option parsing failed: %s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    scratch_peer = g_string_sized_new(64);
+    scratch_text = g_string_sized_new(4096);
+
+    /* SDP bodies travel with every line break escaped, as from JsonGenerator */
+    GString* sdp_frame = g_string_new("{\"sdp\":{\"type\":\"answer\",\"sdp\":\"");
+    GString* sdp_body = g_string_new(NULL);
+    for (gint i = 0; sdp_lines[i]; i++) {
+        g_string_append(sdp_frame, sdp_lines[i]);
+        g_string_append(sdp_frame, "\\r\\n");
+        g_string_append(sdp_body, sdp_lines[i]);
+        g_string_append(sdp_body, "\r\n");
+    }
+    g_string_append(sdp_frame, "\"},\"peer\":\"viewer-17\"}");
+
+    GString* ice_binary = g_string_new(NULL);
+    GString* sdp_binary = g_string_new(NULL);
+    signaling_write_ice_binary(ice_binary, "viewer-17", 0,
+        "candidate:3 1 UDP 2015363327 192.168.1.23 51234 typ host");
+    signaling_write_sdp_binary(sdp_binary, "viewer-17", "answer", sdp_body->str);
+
+    g_print("%d iterations per run\n", iterations);
+    report("ice", ice_frame, ice_binary);
+    report("sdp", sdp_frame->str, sdp_binary);
+
+    g_string_free(sdp_binary, TRUE);
+    g_string_free(ice_binary, TRUE);
+    g_string_free(sdp_body, TRUE);
+    g_string_free(sdp_frame, TRUE);
+    g_string_free(scratch_text, TRUE);
+    g_string_free(scratch_peer, TRUE);
+    g_option_context_free(context);
+    return 0;
+}
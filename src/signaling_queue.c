@@ -0,0 +1,214 @@
+/*
+ * signaling_queue.c — see signaling_queue.h.
+ */
+
+#include "signaling_queue.h"
+
+#include <string.h>
+
+typedef struct {
+    gchar* peer;
+    gchar* data;        /* NUL-terminated, for send_text */
+    gsize len;
+    gboolean binary;
+    gint64 queued_us;
+} QueuedFrame;
+
+static const gchar* priority_names[SIGNALING_PRIORITY_COUNT] = { "sdp", "ice", "stats" };
+
+static void
+queued_frame_free(gpointer data)
+{
+    QueuedFrame* frame = data;
+    g_free(frame->peer);
+    g_free(frame->data);
+    g_free(frame);
+}
+
+static void
+stop_waiting(SignalingQueue* queue)
+{
+    if (queue->writable_source) {
+        g_source_destroy(queue->writable_source);
+        g_clear_pointer(&queue->writable_source, g_source_unref);
+    }
+}
+
+void
+signaling_queue_init(SignalingQueue* queue)
+{
+    memset(queue, 0, sizeof(*queue));
+    for (guint p = 0; p < SIGNALING_PRIORITY_COUNT; p++)
+        g_queue_init(&queue->pending[p]);
+}
+
+void
+signaling_queue_set_sent_func(SignalingQueue* queue, SignalingQueueSentFunc func,
+    gpointer user_data)
+{
+    queue->sent_func = func;
+    queue->sent_data = user_data;
+}
+
+void
+signaling_queue_clear(SignalingQueue* queue)
+{
+    stop_waiting(queue);
+    g_clear_object(&queue->conn);
+    for (guint p = 0; p < SIGNALING_PRIORITY_COUNT; p++)
+        g_queue_clear_full(&queue->pending[p], queued_frame_free);
+}
+
+guint
+signaling_queue_depth(const SignalingQueue* queue)
+{
+    guint depth = 0;
+    for (guint p = 0; p < SIGNALING_PRIORITY_COUNT; p++)
+        depth += queue->pending[p].length;
+    return depth;
+}
+
+/* Streams that cannot be polled are written blocking by libsoup anyway */
+static GPollableOutputStream*
+pollable_output(SoupWebsocketConnection* conn)
+{
+    GOutputStream* out = g_io_stream_get_output_stream(soup_websocket_connection_get_io_stream(conn));
+    if (!G_IS_POLLABLE_OUTPUT_STREAM(out) ||
+        !g_pollable_output_stream_can_poll(G_POLLABLE_OUTPUT_STREAM(out)))
+        return NULL;
+    return G_POLLABLE_OUTPUT_STREAM(out);
+}
+
+static void drain(SignalingQueue* queue);
+
+static gboolean
+on_writable(GObject* stream, gpointer user_data)
+{
+    (void)stream;
+    SignalingQueue* queue = user_data;
+
+    g_clear_pointer(&queue->writable_source, g_source_unref);
+    drain(queue);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+drain(SignalingQueue* queue)
+{
+    /* A failed send can close the connection, and the closed handler may
+     * detach it, so the checks are redone for every frame */
+    while (signaling_queue_depth(queue) > 0) {
+        if (!queue->conn || queue->writable_source ||
+            soup_websocket_connection_get_state(queue->conn) != SOUP_WEBSOCKET_STATE_OPEN)
+            return;
+
+        GPollableOutputStream* out = pollable_output(queue->conn);
+
+        /* Anything handed over now would queue behind libsoup's backlog,
+         * where a later SDP could no longer overtake it */
+        if (out && !g_pollable_output_stream_is_writable(out)) {
+            queue->pushbacks++;
+            queue->writable_source = g_pollable_output_stream_create_source(out, NULL);
+            g_source_set_callback(queue->writable_source, G_SOURCE_FUNC(on_writable), queue, NULL);
+            g_source_attach(queue->writable_source, NULL);
+            return;
+        }
+
+        guint p = 0;
+        while (g_queue_is_empty(&queue->pending[p]))
+            p++;
+        QueuedFrame* frame = g_queue_pop_head(&queue->pending[p]);
+
+        gint64 start_us = g_get_monotonic_time();
+        if (frame->binary)
+            soup_websocket_connection_send_binary(queue->conn, frame->data, frame->len);
+        else
+            soup_websocket_connection_send_text(queue->conn, frame->data);
+        gint64 end_us = g_get_monotonic_time();
+
+        gint64 latency_us = end_us - frame->queued_us;
+        SignalingQueueStats* stats = &queue->stats[p];
+        stats->sent++;
+        stats->latency_total_us += latency_us;
+        stats->latency_max_us = MAX(stats->latency_max_us, latency_us);
+        if (queue->sent_func)
+            queue->sent_func(frame->peer, frame->len, end_us - start_us, queue->sent_data);
+        queued_frame_free(frame);
+    }
+}
+
+void
+signaling_queue_set_connection(SignalingQueue* queue, SoupWebsocketConnection* conn)
+{
+    stop_waiting(queue);
+    g_set_object(&queue->conn, conn);
+    drain(queue);
+}
+
+void
+signaling_queue_push(SignalingQueue* queue, SignalingPriority priority,
+    const gchar* peer, gboolean binary, const gchar* data, gsize len)
+{
+    g_return_if_fail(priority < SIGNALING_PRIORITY_COUNT);
+
+    QueuedFrame* frame = g_new(QueuedFrame, 1);
+    frame->peer = g_strdup(peer);
+    frame->data = g_malloc(len + 1);
+    memcpy(frame->data, data, len);
+    frame->data[len] = '\0';
+    frame->len = len;
+    frame->binary = binary;
+    frame->queued_us = g_get_monotonic_time();
+    g_queue_push_tail(&queue->pending[priority], frame);
+
+    if (signaling_queue_depth(queue) > SIGNALING_QUEUE_MAX_DEPTH) {
+        guint p = SIGNALING_PRIORITY_COUNT - 1;
+        while (g_queue_is_empty(&queue->pending[p]))
+            p--;
+        queued_frame_free(g_queue_pop_head(&queue->pending[p]));
+        queue->dropped++;
+    }
+
+    queue->depth_max = MAX(queue->depth_max, signaling_queue_depth(queue));
+    drain(queue);
+}
+
+guint
+signaling_queue_drop_peer(SignalingQueue* queue, const gchar* peer)
+{
+    guint dropped = 0;
+
+    for (guint p = 0; p < SIGNALING_PRIORITY_COUNT; p++) {
+        GList* link = queue->pending[p].head;
+        while (link) {
+            GList* next = link->next;
+            QueuedFrame* frame = link->data;
+            if (g_strcmp0(frame->peer, peer) == 0) {
+                queued_frame_free(frame);
+                g_queue_delete_link(&queue->pending[p], link);
+                dropped++;
+            }
+            link = next;
+        }
+    }
+    return dropped;
+}
+
+const gchar*
+signaling_queue_write_report(const SignalingQueue* queue, GString* out)
+{
+    g_string_printf(out, "depth %u (max %u), socket full %u times",
+        signaling_queue_depth(queue), queue->depth_max, queue->pushbacks);
+    if (queue->dropped)
+        g_string_append_printf(out, ", %u dropped over %u", queue->dropped, SIGNALING_QUEUE_MAX_DEPTH);
+
+    for (guint p = 0; p < SIGNALING_PRIORITY_COUNT; p++) {
+        const SignalingQueueStats* stats = &queue->stats[p];
+        if (stats->sent == 0)
+            continue;
+        g_string_append_printf(out, ", %s %u sent in %.1f ms avg / %.1f ms max",
+            priority_names[p], stats->sent,
+            stats->latency_total_us / 1000.0 / stats->sent, stats->latency_max_us / 1000.0);
+    }
+    return out->str;
+}
@@ -0,0 +1,79 @@
+/*
+ * signaling_queue.h — prioritised outbound queue for a signaling websocket.
+ *
+ * libsoup writes frames in the order it is handed them and keeps what the
+ * socket does not take in its own FIFO, so a burst of candidates can sit in
+ * front of an SDP answer. Frames wait here instead, one FIFO per priority,
+ * and are only handed to libsoup while the socket is writable: SDP first,
+ * then ICE, then stats. libsoup does not report how much it has buffered,
+ * so the socket's writability stands in for that.
+ *
+ * Frames pushed while there is no open connection (before the first
+ * connect, or during a reconnect) wait for signaling_queue_set_connection().
+ * At most SIGNALING_QUEUE_MAX_DEPTH wait at a time; past that the oldest
+ * frame of the lowest priority is dropped, so a long outage does not pile
+ * up stats and candidates nobody will use. Main loop only.
+ */
+#ifndef SIGNALING_QUEUE_H
+#define SIGNALING_QUEUE_H
+
+#include <libsoup/soup.h>
+
+typedef enum {
+    SIGNALING_PRIORITY_SDP = 0,
+    SIGNALING_PRIORITY_ICE,
+    SIGNALING_PRIORITY_STATS,
+    SIGNALING_PRIORITY_COUNT
+} SignalingPriority;
+
+#define SIGNALING_QUEUE_MAX_DEPTH 256
+
+/* Called for each frame handed to libsoup, with the time the send call took
+ * (framing, and deflating under permessage-deflate) */
+typedef void (*SignalingQueueSentFunc)(const gchar* peer, gsize len, gint64 send_us,
+    gpointer user_data);
+
+typedef struct {
+    guint sent;
+    gint64 latency_total_us;    /* push to hand-over to libsoup */
+    gint64 latency_max_us;
+} SignalingQueueStats;
+
+typedef struct {
+    SoupWebsocketConnection* conn;  /* NULL while disconnected */
+    GQueue pending[SIGNALING_PRIORITY_COUNT];
+    GSource* writable_source;       /* set while waiting for the socket to drain */
+    guint depth_max;
+    guint pushbacks;                /* times the socket was full */
+    guint dropped;                  /* frames over SIGNALING_QUEUE_MAX_DEPTH */
+    SignalingQueueStats stats[SIGNALING_PRIORITY_COUNT];
+    SignalingQueueSentFunc sent_func;
+    gpointer sent_data;
+} SignalingQueue;
+
+void signaling_queue_init(SignalingQueue* queue);
+
+void signaling_queue_set_sent_func(SignalingQueue* queue, SignalingQueueSentFunc func,
+    gpointer user_data);
+
+/* Frees waiting frames and drops the connection. */
+void signaling_queue_clear(SignalingQueue* queue);
+
+/* Sends through conn from now on (NULL: hold frames) and drains if it is open. */
+void signaling_queue_set_connection(SignalingQueue* queue, SoupWebsocketConnection* conn);
+
+/* Copies the frame; binary picks a binary over a text frame. peer tags it
+ * for signaling_queue_drop_peer() and may be NULL. */
+void signaling_queue_push(SignalingQueue* queue, SignalingPriority priority,
+    const gchar* peer, gboolean binary, const gchar* data, gsize len);
+
+/* Discards frames still waiting for peer; returns how many. */
+guint signaling_queue_drop_peer(SignalingQueue* queue, const gchar* peer);
+
+guint signaling_queue_depth(const SignalingQueue* queue);
+
+/* Overwrite out with a one-line summary (depth, pushbacks, drops, latency
+ * per priority) and return out->str. */
+const gchar* signaling_queue_write_report(const SignalingQueue* queue, GString* out);
+
+#endif /* SIGNALING_QUEUE_H */
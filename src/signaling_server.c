@@ -0,0 +1,413 @@
+/*
+ * signaling_server.c — minimal relay signaling server for loopback runs.
+ *
+ * Lets sender, receiver and the main.c demo run without the external host:
+ *
+ *   signaling_server [--port=8443] [--all-interfaces] [--binary-signaling]
+ *                    [--cert=FILE --key=FILE]
+ *   sender   --server=ws://127.0.0.1:8443
+ *   receiver --server=ws://127.0.0.1:8443
+ *
+ * Two kinds of client share one endpoint:
+ *
+ *  - main.c style: "HELLO <id>" registers (reply "HELLO"), "SESSION <id>" pairs
+ *    with a registered peer (reply "SESSION_OK" or "ERROR ..."). After that every
+ *    frame is relayed verbatim to the partner. A registered client may instead
+ *    skip SESSION and send "TO <id> <message>" to any registered peer, which
+ *    receives "FROM <sender> <message>" (main.c --multiplex: many calls over one
+ *    connection). Only that prefix is rewritten.
+ *  - sender/receiver style: no registration. Each connection gets an id "c<N>",
+ *    announced to the others as {"join":"c<N>"} / {"leave":"c<N>"} (what sender
+ *    --fanout listens for). A {"sdp"}/{"ice"} message tagged with another
+ *    client's id goes to that client only, and makes the sender its partner;
+ *    anything else goes to the partner, or to every other unregistered client
+ *    when there is none. Frames are never rewritten.
+ *
+ * A relay cannot translate between JSON and binary frames, so with
+ * --binary-signaling both ends of a call should ask for the same subprotocol.
+ */
+
+#include <libsoup/soup.h>
+
+#include <string.h>
+
+#include "signaling.h"
+
+typedef struct _Client Client;
+
+struct _Client {
+    gchar* id;
+    SoupWebsocketConnection* conn;
+    gboolean registered;    /* sent HELLO: main.c protocol, never gets join/leave */
+    Client* partner;        /* where replies go; cleared when either side leaves */
+};
+
+ /* ---------- Globals ---------- */
+static GMainLoop* loop = NULL;
+static GHashTable* clients = NULL; /* id -> Client* */
+static guint next_client_id = 1;
+
+static gint port = 8443;
+static gboolean all_interfaces = FALSE;
+static gboolean binary_signaling = FALSE;
+static gboolean compress_signaling = FALSE;
+static gchar* cert_file = NULL;
+static gchar* key_file = NULL;
+
+/* Inbound scratch buffer: grown once, reused for every message */
+static GString* rx_peer = NULL;
+
+/* Outbound buffer for join/leave announcements */
+static GString* tx_text = NULL;
+
+/* ---------- Sending ---------- */
+static gboolean
+client_is_open(const Client* client)
+{
+    return soup_websocket_connection_get_state(client->conn) == SOUP_WEBSOCKET_STATE_OPEN;
+}
+
+static void
+relay_frame(Client* to, SoupWebsocketDataType type, GBytes* message)
+{
+    if (!client_is_open(to))
+        return;
+
+    if (type == SOUP_WEBSOCKET_DATA_BINARY) {
+        gsize size = 0;
+        gconstpointer data = g_bytes_get_data(message, &size);
+        soup_websocket_connection_send_binary(to->conn, data, size);
+    }
+    else {
+        soup_websocket_connection_send_text(to->conn, g_bytes_get_data(message, NULL));
+    }
+}
+
+static void
+send_text(Client* to, const gchar* text)
+{
+    if (client_is_open(to))
+        soup_websocket_connection_send_text(to->conn, text);
+}
+
+/* {"join":id} / {"leave":id} to every other unregistered client */
+static void
+announce(const Client* about, const gchar* what)
+{
+    g_string_printf(tx_text, "{\"%s\":", what);
+    signaling_append_string(tx_text, about->id);
+    g_string_append_c(tx_text, '}');
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, clients);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        Client* other = value;
+        if (other != about && !other->registered)
+            send_text(other, tx_text->str);
+    }
+}
+
+/* ---------- main.c protocol: HELLO / SESSION ---------- */
+static void
+handle_hello(Client* client, const gchar* id)
+{
+    if (!id[0] || strchr(id, ' ') || g_hash_table_contains(clients, id)) {
+        send_text(client, "ERROR invalid peer id");
+        return;
+    }
+
+    /* It was announced as an anonymous client when it connected */
+    if (!client->registered)
+        announce(client, "leave");
+
+    g_hash_table_steal(clients, client->id);
+    g_free(client->id);
+    client->id = g_strdup(id);
+    client->registered = TRUE;
+    g_hash_table_insert(clients, client->id, client);
+
+    g_print("[server] '%s' registered\n", client->id);
+    send_text(client, "HELLO");
+}
+
+static void
+handle_session(Client* client, const gchar* id)
+{
+    Client* peer = g_hash_table_lookup(clients, id);
+
+    if (!client->registered) {
+        send_text(client, "ERROR not registered");
+        return;
+    }
+    if (!peer || !peer->registered || peer == client) {
+        gchar* error = g_strdup_printf("ERROR peer '%s' not found", id);
+        send_text(client, error);
+        g_free(error);
+        return;
+    }
+    if (peer->partner) {
+        gchar* error = g_strdup_printf("ERROR peer '%s' busy", id);
+        send_text(client, error);
+        g_free(error);
+        return;
+    }
+
+    client->partner = peer;
+    peer->partner = client;
+    g_print("[server] session '%s' <-> '%s'\n", client->id, peer->id);
+    send_text(client, "SESSION_OK");
+}
+
+/* main.c --multiplex: TO <id> <message> arrives as FROM <sender> <message> */
+static void
+handle_to(Client* client, const gchar* rest)
+{
+    const gchar* payload = strchr(rest, ' ');
+
+    if (!client->registered || !payload) {
+        send_text(client, "ERROR malformed TO");
+        return;
+    }
+
+    gchar* id = g_strndup(rest, payload - rest);
+    Client* peer = g_hash_table_lookup(clients, id);
+
+    /* An unknown peer is answered on behalf of that peer, so only its call ends */
+    if (peer && peer->registered && peer != client) {
+        g_string_printf(tx_text, "FROM %s %s", client->id, payload + 1);
+        send_text(peer, tx_text->str);
+    }
+    else {
+        g_string_printf(tx_text, "FROM %s ERROR peer '%s' not found", id, id);
+        send_text(client, tx_text->str);
+    }
+    g_free(id);
+}
+
+/* ---------- Relay ---------- */
+static void
+route_message(Client* from, SoupWebsocketDataType type, GBytes* message)
+{
+    gsize size = 0;
+    const gchar* data = g_bytes_get_data(message, &size);
+
+    /* Paired main.c clients: everything verbatim, the server reads nothing */
+    if (from->registered) {
+        if (from->partner)
+            relay_frame(from->partner, type, message);
+        return;
+    }
+
+    SignalingMessage msg;
+    JsonParser* parser = NULL;
+    gboolean parsed = type == SOUP_WEBSOCKET_DATA_BINARY
+        ? signaling_parse_binary(data, size, &msg)
+        : signaling_parse_text(data, size, &msg, &parser);
+
+    /* Tagged with someone else's id: deliver there, and remember who to answer */
+    if (parsed && !signaling_span_is_empty(&msg.peer)) {
+        const gchar* peer_id = signaling_span_str(&msg.peer, rx_peer);
+        Client* to = g_hash_table_lookup(clients, peer_id);
+
+        if (to && to != from) {
+            to->partner = from;
+            relay_frame(to, type, message);
+            g_clear_object(&parser);
+            return;
+        }
+    }
+    g_clear_object(&parser);
+
+    if (from->partner) {
+        relay_frame(from->partner, type, message);
+        return;
+    }
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, clients);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        Client* other = value;
+        if (other != from && !other->registered)
+            relay_frame(other, type, message);
+    }
+}
+
+static void
+on_client_message(SoupWebsocketConnection* conn, SoupWebsocketDataType type,
+    GBytes* message, gpointer user_data)
+{
+    (void)conn;
+    Client* client = user_data;
+
+    if (type == SOUP_WEBSOCKET_DATA_TEXT) {
+        const gchar* text = g_bytes_get_data(message, NULL);
+
+        if (g_str_has_prefix(text, "HELLO ")) {
+            handle_hello(client, text + 6);
+            return;
+        }
+        if (g_str_has_prefix(text, "SESSION ")) {
+            handle_session(client, text + 8);
+            return;
+        }
+        if (g_str_has_prefix(text, "TO ")) {
+            handle_to(client, text + 3);
+            return;
+        }
+    }
+
+    route_message(client, type, message);
+}
+
+/* ---------- Clients ---------- */
+static void
+client_free(gpointer data)
+{
+    Client* client = data;
+
+    g_signal_handlers_disconnect_by_data(client->conn, client);
+    g_object_unref(client->conn);
+    g_free(client->id);
+    g_free(client);
+}
+
+static void
+on_client_closed(SoupWebsocketConnection* conn, gpointer user_data)
+{
+    (void)conn;
+    Client* client = user_data;
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, clients);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        Client* other = value;
+        if (other->partner == client)
+            other->partner = NULL;
+    }
+
+    if (!client->registered)
+        announce(client, "leave");
+
+    g_print("[server] '%s' left (%u connected)\n", client->id, g_hash_table_size(clients) - 1);
+    g_hash_table_remove(clients, client->id);
+}
+
+static void
+on_websocket(SoupServer* server, SoupServerMessage* msg, const char* path,
+    SoupWebsocketConnection* conn, gpointer user_data)
+{
+    (void)server;
+    (void)msg;
+    (void)path;
+    (void)user_data;
+
+    /* A HELLO may already have claimed the next "c<N>"; inserting a second
+     * client under that key would free the first one's id under it */
+    Client* client = g_new0(Client, 1);
+    do {
+        g_free(client->id);
+        client->id = g_strdup_printf("c%u", next_client_id++);
+    } while (g_hash_table_contains(clients, client->id));
+    client->conn = g_object_ref(conn);
+    g_hash_table_insert(clients, client->id, client);
+
+    g_signal_connect(conn, "message", G_CALLBACK(on_client_message), client);
+    g_signal_connect(conn, "closed", G_CALLBACK(on_client_closed), client);
+
+    const gchar* protocol = soup_websocket_connection_get_protocol(conn);
+    gboolean deflate = soup_websocket_connection_get_extensions(conn) != NULL;
+    g_print("[server] '%s' connected, %s signaling%s (%u connected)\n", client->id,
+        g_strcmp0(protocol, SIGNALING_PROTOCOL_BINARY) == 0 ? "binary" : "JSON",
+        deflate ? " with permessage-deflate" : "", g_hash_table_size(clients));
+
+    announce(client, "join");
+
+    /* ...and the newcomer learns who was already there, so a sender --fanout
+     * that connects last still offers to every waiting receiver */
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, clients);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        Client* other = value;
+        if (other == client || other->registered)
+            continue;
+        g_string_assign(tx_text, "{\"join\":");
+        signaling_append_string(tx_text, other->id);
+        g_string_append_c(tx_text, '}');
+        send_text(client, tx_text->str);
+    }
+}
+
+/* ---------- CLI ---------- */
+static GOptionEntry entries[] = {
+  {"port", 0, 0, G_OPTION_ARG_INT, &port, "Port to listen on", "PORT"},
+  {"all-interfaces", 0, 0, G_OPTION_ARG_NONE, &all_interfaces, "Listen on every interface instead of loopback only", NULL},
+  {"binary-signaling", 0, 0, G_OPTION_ARG_NONE, &binary_signaling, "Accept the binary signaling subprotocol", NULL},
+  {"compress-signaling", 0, 0, G_OPTION_ARG_NONE, &compress_signaling, "Accept permessage-deflate from clients that offer it", NULL},
+  {"cert", 0, 0, G_OPTION_ARG_FILENAME, &cert_file, "TLS certificate (PEM) to serve wss:// with", "FILE"},
+  {"key", 0, 0, G_OPTION_ARG_FILENAME, &key_file, "TLS private key (PEM) for --cert", "FILE"},
+  {NULL}
+};
+
+int
+main(int argc, char* argv[])
+{
+    GOptionContext* context = g_option_context_new("- relay signaling server");
+    g_option_context_add_main_entries(context, entries, NULL);
+
+    GError* error = NULL;
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("Option parsing failed: %s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    SoupServer* server = soup_server_new("server-header", "signaling-server", NULL);
+
+    /* libsoup accepts permessage-deflate by default; every relayed message
+     * would be inflated and deflated again here, so keep it opt-in */
+    if (!compress_signaling)
+        soup_server_remove_websocket_extension(server, SOUP_TYPE_WEBSOCKET_EXTENSION_DEFLATE);
+
+    if (cert_file) {
+        GTlsCertificate* cert = g_tls_certificate_new_from_files(cert_file,
+            key_file ? key_file : cert_file, &error);
+        if (!cert) {
+            g_printerr("[server] Failed to load certificate: %s\n", error->message);
+            g_error_free(error);
+            return 1;
+        }
+        soup_server_set_tls_certificate(server, cert);
+        g_object_unref(cert);
+    }
+
+    static gchar* protocols[] = { SIGNALING_PROTOCOL_BINARY, SIGNALING_PROTOCOL_JSON, NULL };
+    soup_server_add_websocket_handler(server, NULL, NULL,
+        binary_signaling ? protocols : NULL, on_websocket, NULL, NULL);
+
+    SoupServerListenOptions options = cert_file ? SOUP_SERVER_LISTEN_HTTPS : 0;
+    gboolean ok = all_interfaces
+        ? soup_server_listen_all(server, (guint)port, options, &error)
+        : soup_server_listen_local(server, (guint)port, options, &error);
+    if (!ok) {
+        g_printerr("[server] Failed to listen on port %d: %s\n", port, error->message);
+        g_error_free(error);
+        return 1;
+    }
+
+    clients = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, client_free);
+    rx_peer = g_string_sized_new(64);
+    tx_text = g_string_sized_new(256);
+
+    g_print("[server] Listening on %s://%s:%d\n", cert_file ? "wss" : "ws",
+        all_interfaces ? "0.0.0.0" : "127.0.0.1", port);
+
+    loop = g_main_loop_new(NULL, FALSE);
+    g_main_loop_run(loop);
+
+    return 0;
+}
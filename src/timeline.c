@@ -0,0 +1,104 @@
+/*
+ * timeline.c — see timeline.h.
+ */
+
+#include "timeline.h"
+
+#include "signaling.h"
+
+static const gchar* milestone_names[TIMELINE_N_MILESTONES] = {
+    "ws_connected",
+    "session_created",
+    "offer_sent",
+    "offer_received",
+    "answer_sent",
+    "answer_set",
+    "first_local_ice",
+    "first_remote_ice",
+    "ice_connected",
+    "dtls_connected",
+    "first_rtp",
+    "first_frame",
+};
+
+void
+timeline_init(Timeline* tl)
+{
+    for (guint i = 0; i < TIMELINE_N_MILESTONES; i++) {
+        tl->claimed[i] = 0;
+        tl->at_us[i] = 0;
+    }
+}
+
+gboolean
+timeline_mark_at(Timeline* tl, TimelineMilestone milestone, gint64 at_us)
+{
+    g_return_val_if_fail(milestone < TIMELINE_N_MILESTONES, FALSE);
+
+    /* The claim makes "first" well defined across threads; the stamp is
+     * published by the second step, so a reader that sees 2 sees at_us too */
+    if (at_us <= 0 || !g_atomic_int_compare_and_exchange(&tl->claimed[milestone], 0, 1))
+        return FALSE;
+
+    tl->at_us[milestone] = at_us;
+    g_atomic_int_set(&tl->claimed[milestone], 2);
+    return TRUE;
+}
+
+gboolean
+timeline_mark(Timeline* tl, TimelineMilestone milestone)
+{
+    return timeline_mark_at(tl, milestone, g_get_monotonic_time());
+}
+
+gboolean
+timeline_has(const Timeline* tl, TimelineMilestone milestone)
+{
+    return milestone < TIMELINE_N_MILESTONES &&
+        g_atomic_int_get((gint*)&tl->claimed[milestone]) == 2;
+}
+
+/* 0 unless the milestone is stamped */
+static gint64
+stamp_of(const Timeline* tl, guint milestone)
+{
+    return timeline_has(tl, milestone) ? tl->at_us[milestone] : 0;
+}
+
+const gchar*
+timeline_milestone_name(TimelineMilestone milestone)
+{
+    return milestone < TIMELINE_N_MILESTONES ? milestone_names[milestone] : "unknown";
+}
+
+const gchar*
+timeline_write_json(const Timeline* tl, GString* out, const gchar* role, const gchar* peer)
+{
+    gint64 origin = 0, last = 0;
+    for (guint i = 0; i < TIMELINE_N_MILESTONES; i++) {
+        gint64 t = stamp_of(tl, i);
+        if (t == 0)
+            continue;
+        if (origin == 0 || t < origin)
+            origin = t;
+        if (t > last)
+            last = t;
+    }
+
+    g_string_assign(out, "{\"role\":");
+    signaling_append_string(out, role);
+    g_string_append(out, ",\"peer\":");
+    signaling_append_string(out, peer ? peer : "");
+
+    /* Milestones go out in setup order, which is not always the order reached */
+    for (guint i = 0; i < TIMELINE_N_MILESTONES; i++) {
+        gint64 t = stamp_of(tl, i);
+        if (t == 0)
+            continue;
+        g_string_append_printf(out, ",\"%s\":%.1f", milestone_names[i],
+            (t - origin) / 1000.0);
+    }
+
+    g_string_append_printf(out, ",\"total_ms\":%.1f}", (last - origin) / 1000.0);
+    return out->str;
+}
@@ -0,0 +1,55 @@
+/*
+ * timeline.h — per-session connection-setup timeline.
+ *
+ * Each milestone is stamped once, with g_get_monotonic_time(), the first time
+ * it is reached. Marks may come from any thread (webrtcbin signals, pad probes
+ * on streaming threads); later marks of the same milestone are ignored.
+ * timeline_write_json() turns the stamps into one line of JSON, with every
+ * milestone given in milliseconds since the earliest one.
+ */
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <glib.h>
+
+typedef enum {
+    TIMELINE_WS_CONNECTED = 0,
+    TIMELINE_SESSION_CREATED,
+    TIMELINE_OFFER_SENT,
+    TIMELINE_OFFER_RECEIVED,
+    TIMELINE_ANSWER_SENT,
+    TIMELINE_ANSWER_SET,        /* remote answer applied (offerer) */
+    TIMELINE_FIRST_LOCAL_ICE,
+    TIMELINE_FIRST_REMOTE_ICE,
+    TIMELINE_ICE_CONNECTED,
+    TIMELINE_DTLS_CONNECTED,    /* peer connection state "connected" */
+    TIMELINE_FIRST_RTP,
+    TIMELINE_FIRST_FRAME,       /* first decoded frame out of the decoder */
+    TIMELINE_N_MILESTONES
+} TimelineMilestone;
+
+typedef struct {
+    gint claimed[TIMELINE_N_MILESTONES]; /* 0 free, 1 being stamped, 2 stamped */
+    gint64 at_us[TIMELINE_N_MILESTONES]; /* valid once claimed is 2 */
+} Timeline;
+
+void timeline_init(Timeline* tl);
+
+/* Stamps milestone with the current time. Returns TRUE for the first mark. */
+gboolean timeline_mark(Timeline* tl, TimelineMilestone milestone);
+
+/* Same, with a timestamp taken elsewhere (e.g. the websocket connect). */
+gboolean timeline_mark_at(Timeline* tl, TimelineMilestone milestone, gint64 at_us);
+
+/* Whether milestone has been stamped; safe from any thread. */
+gboolean timeline_has(const Timeline* tl, TimelineMilestone milestone);
+
+const gchar* timeline_milestone_name(TimelineMilestone milestone);
+
+/* Overwrite out with
+ * {"role":...,"peer":...,"ws_connected":0.0,...,"total_ms":N}
+ * Milestones not reached are left out. */
+const gchar* timeline_write_json(const Timeline* tl, GString* out,
+    const gchar* role, const gchar* peer);
+
+#endif /* TIMELINE_H */
@@ -0,0 +1,96 @@
+/*
+ * backoff_test.c — checks of the reconnect backoff.
+ */
+
+#include "backoff.h"
+
+#define DRAWS 200
+
+typedef struct {
+    const gchar* name;
+    guint base_ms;
+    guint max_ms;
+    guint ceilings[8];      /* per attempt; each delay is in [c/2, c] */
+} BackoffCase;
+
+static const BackoffCase cases[] = {
+    { "doubles-to-max", 500, 8000, { 500, 1000, 2000, 4000, 8000, 8000, 8000, 8000 } },
+    { "max-not-power", 500, 3000, { 500, 1000, 2000, 3000, 3000, 3000, 3000, 3000 } },
+    { "zero-base", 0, 4, { 1, 2, 4, 4, 4, 4, 4, 4 } },
+    { "max-below-base", 1000, 10, { 1000, 1000, 1000, 1000, 1000, 1000, 1000, 1000 } },
+    { "huge-max", 1u << 30, G_MAXUINT,
+        { 1u << 30, G_MAXINT, G_MAXINT, G_MAXINT, G_MAXINT, G_MAXINT, G_MAXINT, G_MAXINT } },
+};
+
+static void
+check_attempts(Backoff* backoff, const BackoffCase* c)
+{
+    for (guint a = 0; a < G_N_ELEMENTS(c->ceilings); a++) {
+        guint ceiling = c->ceilings[a];
+        guint delay = backoff_next_ms(backoff);
+
+        g_assert_cmpuint(delay, >=, ceiling / 2);
+        g_assert_cmpuint(delay, <=, ceiling);
+    }
+}
+
+static void
+test_ceilings(void)
+{
+    for (guint i = 0; i < G_N_ELEMENTS(cases); i++) {
+        const BackoffCase* c = &cases[i];
+
+        g_test_message("%s", c->name);
+        for (guint d = 0; d < DRAWS; d++) {
+            Backoff backoff;
+            backoff_init(&backoff, c->base_ms, c->max_ms);
+            check_attempts(&backoff, c);
+        }
+    }
+}
+
+/* A success starts the next outage from base_ms, however long the last one */
+static void
+test_reset(void)
+{
+    const BackoffCase* c = &cases[0];
+    Backoff backoff;
+
+    backoff_init(&backoff, c->base_ms, c->max_ms);
+    for (guint i = 0; i < 1000; i++)
+        g_assert_cmpuint(backoff_next_ms(&backoff), <=, c->max_ms);
+    g_assert_cmpuint(backoff.attempt, ==, 1000);
+
+    backoff_reset(&backoff);
+    g_assert_cmpuint(backoff.attempt, ==, 0);
+    check_attempts(&backoff, c);
+}
+
+/* The draw covers the upper half of the ceiling, not a single value */
+static void
+test_jitter(void)
+{
+    guint lowest = G_MAXUINT, highest = 0;
+
+    for (guint d = 0; d < DRAWS; d++) {
+        Backoff backoff;
+        backoff_init(&backoff, 8000, 8000);
+        guint delay = backoff_next_ms(&backoff);
+        lowest = MIN(lowest, delay);
+        highest = MAX(highest, delay);
+    }
+    g_assert_cmpuint(lowest, <, 5000);
+    g_assert_cmpuint(highest, >, 7000);
+}
+
+int
+main(int argc, char** argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/backoff/ceilings", test_ceilings);
+    g_test_add_func("/backoff/reset", test_reset);
+    g_test_add_func("/backoff/jitter", test_jitter);
+
+    return g_test_run();
+}
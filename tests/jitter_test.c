@@ -0,0 +1,124 @@
+/*
+ * jitter_test.c — checks of the receiver's jitterbuffer/queue controller.
+ */
+
+#include "jitter.h"
+
+typedef struct {
+    gdouble jitter;         /* seconds, as inbound-rtp reports it */
+    guint64 received;
+    gint64 lost;
+    gint64 at_ms;
+} Report;
+
+#define MAX_REPORTS 4
+
+typedef struct {
+    const gchar* name;
+    Report reports[MAX_REPORTS];
+    guint n_reports;
+    gboolean changed;       /* result of the last report */
+    guint latency_ms;
+    guint queue_buffers;
+} JitterCase;
+
+/* Every case starts from jitter_tuner_init(20, 1000, 4, 1000): 265 ms, 4 buffers */
+static const JitterCase cases[] = {
+    { "first-report-spike", { { 0.1, 0, 0, 1000 } }, 1,
+        TRUE, 410, 4 },
+    { "small-step-ignored", { { 0.065, 0, 0, 1000 } }, 1,
+        FALSE, 265, 4 },
+    { "calm-decays-10pct", { { 0, 0, 0, 1000 } }, 1,
+        TRUE, 238, 4 },
+    { "clamped-to-max", { { 1.0, 0, 0, 1000 } }, 1,
+        TRUE, 1000, 4 },
+    { "loss-adds-half", { { 0.05, 1000, 0, 1000 }, { 0.05, 1980, 20, 2000 } }, 2,
+        TRUE, 315, 463 },
+    { "loss-under-threshold", { { 0.05, 1000, 0, 1000 }, { 0.05, 2000, 5, 2000 } }, 2,
+        TRUE, 214, 321 },
+    /* A new SSRC restarts the counters: no rate or loss from that report,
+     * the next one measures from the new baseline */
+    { "counter-reset", { { 0.05, 5000, 10, 1000 }, { 0.05, 100, 0, 2000 },
+        { 0.05, 1100, 0, 3000 } }, 3,
+        TRUE, 210, 315 },
+    { "clock-not-advancing", { { 0.05, 1000, 0, 1000 }, { 0.05, 2000, 0, 1000 } }, 2,
+        TRUE, 214, 4 },
+};
+
+static void
+test_reports(void)
+{
+    for (guint i = 0; i < G_N_ELEMENTS(cases); i++) {
+        const JitterCase* c = &cases[i];
+        JitterTuner tuner;
+        gboolean changed = FALSE;
+
+        g_test_message("%s", c->name);
+        jitter_tuner_init(&tuner, 20, 1000, 4, 1000);
+        g_assert_cmpuint(tuner.latency_ms, ==, 265);
+
+        for (guint r = 0; r < c->n_reports; r++) {
+            const Report* report = &c->reports[r];
+            changed = jitter_tuner_on_report(&tuner, report->jitter, report->received,
+                report->lost, report->at_ms * 1000);
+        }
+        g_assert_cmpint(changed, ==, c->changed);
+        g_assert_cmpuint(tuner.latency_ms, ==, c->latency_ms);
+        g_assert_cmpuint(tuner.queue_buffers, ==, c->queue_buffers);
+    }
+}
+
+typedef struct {
+    guint min_ms;
+    gdouble jitter;
+    guint settled_ms;
+} DecayCase;
+
+/* A calm stream comes down 10% a report until it reaches 4x jitter + 10 ms,
+ * or min_ms above that, instead of stalling within 10% of it */
+static const DecayCase decay_cases[] = {
+    { 0, 0, 10 },
+    { 20, 0, 20 },
+    { 0, 0.005, 30 },
+};
+
+static void
+test_decay_floor(void)
+{
+    for (guint i = 0; i < G_N_ELEMENTS(decay_cases); i++) {
+        const DecayCase* c = &decay_cases[i];
+        JitterTuner tuner;
+
+        jitter_tuner_init(&tuner, c->min_ms, 400, 1, 100);
+        for (guint r = 0; r < 100; r++)
+            jitter_tuner_on_report(&tuner, c->jitter, 0, 0, (gint64)(r + 1) * G_USEC_PER_SEC);
+        g_assert_cmpuint(tuner.latency_ms, ==, c->settled_ms);
+        g_assert_false(jitter_tuner_on_report(&tuner, c->jitter, 0, 0, 101 * G_USEC_PER_SEC));
+    }
+}
+
+/* Inverted or zero bounds are straightened out */
+static void
+test_init_bounds(void)
+{
+    JitterTuner tuner;
+
+    jitter_tuner_init(&tuner, 200, 100, 0, 0);
+    g_assert_cmpuint(tuner.max_ms, ==, 200);
+    g_assert_cmpuint(tuner.latency_ms, ==, 200);
+    g_assert_cmpuint(tuner.min_buffers, ==, 1);
+    g_assert_cmpuint(tuner.max_buffers, ==, 1);
+    g_assert_cmpuint(tuner.queue_buffers, ==, 1);
+}
+
+int
+main(int argc, char** argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/jitter/reports", test_reports);
+    g_test_add_func("/jitter/decay-floor", test_decay_floor);
+    g_test_add_func("/jitter/init-bounds", test_init_bounds);
+
+    return g_test_run();
+}
@@ -0,0 +1,123 @@
+/*
+ * signaling_queue_test.c — checks of the outbound queue's hold and drop
+ * policy. No connection is set, so every frame stays queued.
+ */
+
+#include "signaling_queue.h"
+
+#include <string.h>
+
+typedef struct {
+    const gchar* name;
+    guint n_sdp;                /* queued first, tagged sdp-0, sdp-1, ... */
+    guint n_ice;                /* then ice-0, ice-1, ... */
+    guint n_stats;              /* then stats-0, stats-1, ... */
+    SignalingPriority priority; /* of the frame pushed last, tagged "new" */
+    const gchar* dropped;       /* NULL: nothing dropped */
+} DropCase;
+
+static const DropCase drop_cases[] = {
+    { "under-limit", 10, 10, 10, SIGNALING_PRIORITY_SDP, NULL },
+    { "at-limit", 100, 100, 55, SIGNALING_PRIORITY_STATS, NULL },
+    { "oldest-stats", 100, 100, 56, SIGNALING_PRIORITY_SDP, "stats-0" },
+    { "stats-before-older-ice", 0, 255, 1, SIGNALING_PRIORITY_ICE, "stats-0" },
+    { "oldest-ice", 1, 255, 0, SIGNALING_PRIORITY_SDP, "ice-0" },
+    { "new-frame-itself", 256, 0, 0, SIGNALING_PRIORITY_STATS, "new" },
+    { "oldest-sdp", 256, 0, 0, SIGNALING_PRIORITY_SDP, "sdp-0" },
+};
+
+static void
+push_tagged(SignalingQueue* queue, SignalingPriority priority, const gchar* prefix, guint n)
+{
+    for (guint i = 0; i < n; i++) {
+        gchar* peer = g_strdup_printf("%s-%u", prefix, i);
+        signaling_queue_push(queue, priority, peer, FALSE, peer, strlen(peer));
+        g_free(peer);
+    }
+}
+
+static void
+test_drop_policy(void)
+{
+    for (guint i = 0; i < G_N_ELEMENTS(drop_cases); i++) {
+        const DropCase* c = &drop_cases[i];
+        guint total = c->n_sdp + c->n_ice + c->n_stats + 1;
+        SignalingQueue queue;
+
+        g_test_message("%s", c->name);
+        signaling_queue_init(&queue);
+        push_tagged(&queue, SIGNALING_PRIORITY_SDP, "sdp", c->n_sdp);
+        push_tagged(&queue, SIGNALING_PRIORITY_ICE, "ice", c->n_ice);
+        push_tagged(&queue, SIGNALING_PRIORITY_STATS, "stats", c->n_stats);
+        signaling_queue_push(&queue, c->priority, "new", FALSE, "new", 3);
+
+        g_assert_cmpuint(signaling_queue_depth(&queue), ==, MIN(total, SIGNALING_QUEUE_MAX_DEPTH));
+        g_assert_cmpuint(queue.depth_max, ==, MIN(total, SIGNALING_QUEUE_MAX_DEPTH));
+        g_assert_cmpuint(queue.dropped, ==, c->dropped ? 1 : 0);
+        if (c->dropped)
+            g_assert_cmpuint(signaling_queue_drop_peer(&queue, c->dropped), ==, 0);
+        if (g_strcmp0(c->dropped, "new") != 0)
+            g_assert_cmpuint(signaling_queue_drop_peer(&queue, "new"), ==, 1);
+
+        signaling_queue_clear(&queue);
+        g_assert_cmpuint(signaling_queue_depth(&queue), ==, 0);
+    }
+}
+
+/* A long outage keeps the newest frames of the most important kind */
+static void
+test_long_outage(void)
+{
+    SignalingQueue queue;
+
+    signaling_queue_init(&queue);
+    push_tagged(&queue, SIGNALING_PRIORITY_SDP, "sdp", 2);
+    push_tagged(&queue, SIGNALING_PRIORITY_STATS, "stats", 1000);
+    push_tagged(&queue, SIGNALING_PRIORITY_ICE, "ice", 1000);
+
+    g_assert_cmpuint(signaling_queue_depth(&queue), ==, SIGNALING_QUEUE_MAX_DEPTH);
+    g_assert_cmpuint(queue.dropped, ==, 2 + 1000 + 1000 - SIGNALING_QUEUE_MAX_DEPTH);
+    g_assert_cmpuint(queue.pending[SIGNALING_PRIORITY_SDP].length, ==, 2);
+    g_assert_cmpuint(queue.pending[SIGNALING_PRIORITY_STATS].length, ==, 0);
+    g_assert_cmpuint(queue.pending[SIGNALING_PRIORITY_ICE].length, ==, SIGNALING_QUEUE_MAX_DEPTH - 2);
+    g_assert_cmpuint(signaling_queue_drop_peer(&queue, "ice-746"), ==, 1);
+    g_assert_cmpuint(signaling_queue_drop_peer(&queue, "ice-745"), ==, 0);
+
+    signaling_queue_clear(&queue);
+}
+
+/* Frames of one peer go, untagged and other peers' frames stay */
+static void
+test_drop_peer(void)
+{
+    SignalingQueue queue;
+
+    signaling_queue_init(&queue);
+    signaling_queue_push(&queue, SIGNALING_PRIORITY_SDP, "a", FALSE, "1", 1);
+    signaling_queue_push(&queue, SIGNALING_PRIORITY_ICE, "b", FALSE, "2", 1);
+    signaling_queue_push(&queue, SIGNALING_PRIORITY_ICE, "a", TRUE, "3", 1);
+    signaling_queue_push(&queue, SIGNALING_PRIORITY_STATS, NULL, FALSE, "4", 1);
+    signaling_queue_push(&queue, SIGNALING_PRIORITY_STATS, "a", FALSE, "5", 1);
+
+    g_assert_cmpuint(signaling_queue_drop_peer(&queue, "a"), ==, 3);
+    g_assert_cmpuint(signaling_queue_depth(&queue), ==, 2);
+    g_assert_cmpuint(signaling_queue_drop_peer(&queue, "a"), ==, 0);
+    g_assert_cmpuint(signaling_queue_drop_peer(&queue, NULL), ==, 1);
+    g_assert_cmpuint(signaling_queue_drop_peer(&queue, "b"), ==, 1);
+    g_assert_cmpuint(signaling_queue_depth(&queue), ==, 0);
+    g_assert_cmpuint(queue.dropped, ==, 0);
+
+    signaling_queue_clear(&queue);
+}
+
+int
+main(int argc, char** argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/signaling-queue/drop-policy", test_drop_policy);
+    g_test_add_func("/signaling-queue/long-outage", test_long_outage);
+    g_test_add_func("/signaling-queue/drop-peer", test_drop_peer);
+
+    return g_test_run();
+}
@@ -0,0 +1,295 @@
+/*
+ * signaling_test.c — table-driven checks of the three signaling parse paths:
+ * the in-place scanner, the json-glib fallback and the binary framing.
+ */
+
+#include "signaling.h"
+
+#include <string.h>
+
+typedef struct {
+    const gchar* name;
+    const gchar* input;
+    SignalingMsgType type;
+    const gchar* peer;          /* unescaped; NULL: not checked */
+    const gchar* value;         /* first candidate, or the SDP text */
+    guint mlineindex;
+    guint n_ice;
+} TextCase;
+
+#define CANDIDATE "candidate:1 1 udp 2122260223 192.0.2.1 54400 typ host"
+
+/* Shapes both text paths accept, with the same result */
+static const TextCase valid_cases[] = {
+    { "ice", "{\"ice\":{\"candidate\":\"" CANDIDATE "\",\"sdpMLineIndex\":1}}",
+        SIGNALING_MSG_ICE, "", CANDIDATE, 1, 1 },
+    { "ice-peer", "{\"ice\":{\"candidate\":\"" CANDIDATE "\",\"sdpMLineIndex\":0},\"peer\":\"viewer-1\"}",
+        SIGNALING_MSG_ICE, "viewer-1", CANDIDATE, 0, 1 },
+    { "ice-no-index", "{\"ice\":{\"candidate\":\"" CANDIDATE "\"}}",
+        SIGNALING_MSG_ICE, "", CANDIDATE, 0, 1 },
+    { "ice-batch", "{\"ice\":[{\"candidate\":\"a\",\"sdpMLineIndex\":2},{\"candidate\":\"b\"}]}",
+        SIGNALING_MSG_ICE, "", "a", 2, 2 },
+    { "sdp", "{\"sdp\":{\"type\":\"offer\",\"sdp\":\"v=0\\r\\no=- 1 1 IN IP4 0.0.0.0\\r\\n\"}}",
+        SIGNALING_MSG_SDP, "", "v=0\r\no=- 1 1 IN IP4 0.0.0.0\r\n", 0, 0 },
+    { "join", "{\"join\":\"c1\"}",
+        SIGNALING_MSG_JOIN, "c1", NULL, 0, 0 },
+    { "leave", "{\"leave\":\"c1\"}",
+        SIGNALING_MSG_LEAVE, "c1", NULL, 0, 0 },
+    { "escapes", "{\"leave\":\"a\\\"b\\\\c\\/d\\te\"}",
+        SIGNALING_MSG_LEAVE, "a\"b\\c/d\te", NULL, 0, 0 },
+    { "unicode", "{\"leave\":\"caf\\u00e9\"}",
+        SIGNALING_MSG_LEAVE, "caf\xc3\xa9", NULL, 0, 0 },
+    { "surrogate-pair", "{\"leave\":\"\\ud83d\\ude00\"}",
+        SIGNALING_MSG_LEAVE, "\xf0\x9f\x98\x80", NULL, 0, 0 },
+};
+
+typedef struct {
+    const gchar* name;
+    const gchar* input;
+} InvalidCase;
+
+/* Messages neither text path may accept, json-glib's leniency included */
+static const InvalidCase invalid_cases[] = {
+    { "bad-escape", "{\"leave\":\"a\\xb\"}" },
+    { "bad-hex", "{\"leave\":\"\\u00zz\"}" },
+    { "short-hex", "{\"leave\":\"\\u00\"}" },
+    { "negative-index", "{\"ice\":{\"candidate\":\"a\",\"sdpMLineIndex\":-1}}" },
+    { "string-index", "{\"ice\":{\"candidate\":\"a\",\"sdpMLineIndex\":\"0\"}}" },
+    { "no-candidate", "{\"ice\":{\"sdpMLineIndex\":0}}" },
+    { "empty-batch", "{\"ice\":[]}" },
+    { "sdp-no-type", "{\"sdp\":{\"sdp\":\"v=0\"}}" },
+    { "not-object", "[\"ice\"]" },
+    { "truncated", "{\"ice\":{\"candidate\":\"a\"" },
+    { "nul-escape", "{\"leave\":\"a\\u0000b\"}" },
+    { "lone-high-surrogate", "{\"leave\":\"\\ud83d\"}" },
+    { "lone-low-surrogate", "{\"leave\":\"\\ude00\"}" },
+    { "high-surrogate-then-text", "{\"leave\":\"\\ud83dx\"}" },
+    { "bad-escape-other-shape", "{\"other\":\"\\q\",\"leave\":\"c1\"}" },
+};
+
+static void
+check_message(const TextCase* c, const SignalingMessage* msg)
+{
+    GString* scratch = g_string_new(NULL);
+
+    g_assert_cmpint(msg->type, ==, c->type);
+    if (c->peer)
+        g_assert_cmpstr(signaling_span_str(&msg->peer, scratch), ==, c->peer);
+    if (c->type == SIGNALING_MSG_ICE) {
+        g_assert_cmpuint(msg->n_ice, ==, c->n_ice);
+        g_assert_cmpstr(signaling_span_str(&msg->ice[0].candidate, scratch), ==, c->value);
+        g_assert_cmpuint(msg->ice[0].mlineindex, ==, c->mlineindex);
+    }
+    else if (c->type == SIGNALING_MSG_SDP) {
+        g_assert_cmpstr(signaling_span_str(&msg->sdp, scratch), ==, c->value);
+    }
+
+    g_string_free(scratch, TRUE);
+}
+
+static void
+test_fast_valid(void)
+{
+    for (guint i = 0; i < G_N_ELEMENTS(valid_cases); i++) {
+        const TextCase* c = &valid_cases[i];
+        SignalingMessage msg;
+
+        g_test_message("%s", c->name);
+        g_assert_true(signaling_parse_fast(c->input, strlen(c->input), &msg));
+        check_message(c, &msg);
+    }
+}
+
+static void
+test_json_valid(void)
+{
+    for (guint i = 0; i < G_N_ELEMENTS(valid_cases); i++) {
+        const TextCase* c = &valid_cases[i];
+        JsonParser* parser = json_parser_new();
+        SignalingMessage msg;
+
+        g_test_message("%s", c->name);
+        g_assert_true(signaling_parse_json(parser, c->input, strlen(c->input), &msg));
+        check_message(c, &msg);
+        g_object_unref(parser);
+    }
+}
+
+static void
+test_text_invalid(void)
+{
+    for (guint i = 0; i < G_N_ELEMENTS(invalid_cases); i++) {
+        const InvalidCase* c = &invalid_cases[i];
+        JsonParser* parser = NULL;
+        SignalingMessage msg;
+
+        g_test_message("%s", c->name);
+        g_assert_false(signaling_parse_fast(c->input, strlen(c->input), &msg));
+        g_assert_false(signaling_parse_text(c->input, strlen(c->input), &msg, &parser));
+        g_assert_null(parser);
+    }
+}
+
+/* Over SIGNALING_ICE_BATCH_MAX: the first ones are kept, the rest counted */
+static void
+test_batch_overflow(void)
+{
+    const guint total = SIGNALING_ICE_BATCH_MAX + 8;
+    GString* items = g_string_new(NULL);
+    GString* frame = g_string_new(NULL);
+    GString* scratch = g_string_new(NULL);
+    JsonParser* parser = json_parser_new();
+    SignalingMessage msg;
+
+    for (guint i = 0; i < total; i++) {
+        gchar* candidate = g_strdup_printf("candidate:%u", i);
+        if (i > 0)
+            g_string_append_c(items, ',');
+        signaling_append_ice(items, i, candidate);
+        g_free(candidate);
+    }
+    signaling_write_ice_batch(frame, "p", items, total);
+
+    g_assert_true(signaling_parse_fast(frame->str, frame->len, &msg));
+    g_assert_cmpuint(msg.n_ice, ==, SIGNALING_ICE_BATCH_MAX);
+    g_assert_cmpuint(msg.n_ice_dropped, ==, 8);
+    g_assert_cmpstr(signaling_span_str(&msg.ice[SIGNALING_ICE_BATCH_MAX - 1].candidate, scratch), ==,
+        "candidate:31");
+
+    g_assert_true(signaling_parse_json(parser, frame->str, frame->len, &msg));
+    g_assert_cmpuint(msg.n_ice, ==, SIGNALING_ICE_BATCH_MAX);
+    g_assert_cmpuint(msg.n_ice_dropped, ==, 8);
+
+    g_string_truncate(items, 0);
+    for (guint i = 0; i < total; i++)
+        signaling_append_ice_binary(items, i, "c");
+    signaling_write_ice_batch_binary(frame, "p", items);
+    g_assert_true(signaling_parse_binary(frame->str, frame->len, &msg));
+    g_assert_cmpuint(msg.n_ice, ==, SIGNALING_ICE_BATCH_MAX);
+    g_assert_cmpuint(msg.n_ice_dropped, ==, 8);
+
+    g_object_unref(parser);
+    g_string_free(scratch, TRUE);
+    g_string_free(frame, TRUE);
+    g_string_free(items, TRUE);
+}
+
+/* Whatever the writer escapes, the scanner takes back unchanged */
+static void
+test_text_round_trip(void)
+{
+    static const gchar* strings[] = {
+        CANDIDATE,
+        "quote \" backslash \\ slash /",
+        "controls \b\f\n\r\t\x01\x1f",
+        "utf-8 caf\xc3\xa9",
+    };
+    GString* frame = g_string_new(NULL);
+    GString* scratch = g_string_new(NULL);
+
+    for (guint i = 0; i < G_N_ELEMENTS(strings); i++) {
+        SignalingMessage msg;
+
+        signaling_write_ice(frame, strings[i], 3, strings[i]);
+        g_assert_true(signaling_parse_fast(frame->str, frame->len, &msg));
+        g_assert_cmpstr(signaling_span_str(&msg.peer, scratch), ==, strings[i]);
+        g_assert_cmpstr(signaling_span_str(&msg.ice[0].candidate, scratch), ==, strings[i]);
+        g_assert_cmpuint(msg.ice[0].mlineindex, ==, 3);
+
+        signaling_write_sdp(frame, NULL, "answer", strings[i]);
+        g_assert_true(signaling_parse_fast(frame->str, frame->len, &msg));
+        g_assert_true(signaling_span_is_empty(&msg.peer));
+        g_assert_true(signaling_span_equal(&msg.sdp_type, "answer"));
+        g_assert_cmpstr(signaling_span_str(&msg.sdp, scratch), ==, strings[i]);
+    }
+
+    g_string_free(scratch, TRUE);
+    g_string_free(frame, TRUE);
+}
+
+typedef struct {
+    const gchar* name;
+    const gchar* frame;
+    gsize len;
+    gboolean ok;
+} BinaryCase;
+
+/* Hand-built frames: type byte, then { tag, varint length, bytes } fields */
+static const BinaryCase binary_cases[] = {
+    { "ice", "\x02\x04\x02\x00" "a", 5, TRUE },
+    { "ice-unknown-field", "\x02\x09\x01z\x04\x02\x00" "a", 8, TRUE },
+    { "leave", "\x04\x01\x02" "c1", 5, TRUE },
+    { "empty", "", 0, FALSE },
+    { "ice-none", "\x02", 1, FALSE },
+    { "leave-no-peer", "\x04", 1, FALSE },
+    { "sdp-no-type", "\x01\x03\x03v=0", 6, FALSE },
+    { "length-past-end", "\x02\x04\x09\x00" "a", 5, FALSE },
+    { "unterminated-varint", "\x02\x04\x80", 3, FALSE },
+    { "unknown-type", "\x09\x01\x01p", 4, FALSE },
+    { "peer-nul", "\x04\x01\x03" "a\0x", 6, FALSE },
+    { "ice-nul", "\x02\x04\x03\x00" "a\0", 6, FALSE },
+    { "sdp-nul", "\x01\x02\x05" "offer" "\x03\x03" "v\0" "0", 13, FALSE },
+    { "join-empty-peer", "\x03\x01\x00", 3, FALSE },
+    { "leave-empty-peer", "\x04\x01\x00", 3, FALSE },
+};
+
+static void
+test_binary(void)
+{
+    for (guint i = 0; i < G_N_ELEMENTS(binary_cases); i++) {
+        const BinaryCase* c = &binary_cases[i];
+        SignalingMessage msg;
+
+        g_test_message("%s", c->name);
+        g_assert_cmpint(signaling_parse_binary(c->frame, c->len, &msg), ==, c->ok);
+    }
+}
+
+static void
+test_binary_round_trip(void)
+{
+    GString* frame = g_string_new(NULL);
+    GString* scratch = g_string_new(NULL);
+    SignalingMessage msg;
+
+    signaling_write_ice_binary(frame, "viewer-1", 300, CANDIDATE);
+    g_assert_true(signaling_parse_binary(frame->str, frame->len, &msg));
+    g_assert_cmpint(msg.type, ==, SIGNALING_MSG_ICE);
+    g_assert_cmpstr(signaling_span_str(&msg.peer, scratch), ==, "viewer-1");
+    g_assert_cmpuint(msg.n_ice, ==, 1);
+    g_assert_cmpuint(msg.ice[0].mlineindex, ==, 300);
+    g_assert_cmpstr(signaling_span_str(&msg.ice[0].candidate, scratch), ==, CANDIDATE);
+
+    signaling_write_sdp_binary(frame, NULL, "offer", "v=0\r\n");
+    g_assert_true(signaling_parse_binary(frame->str, frame->len, &msg));
+    g_assert_cmpint(msg.type, ==, SIGNALING_MSG_SDP);
+    g_assert_true(signaling_span_is_empty(&msg.peer));
+    g_assert_true(signaling_span_equal(&msg.sdp_type, "offer"));
+    g_assert_cmpstr(signaling_span_str(&msg.sdp, scratch), ==, "v=0\r\n");
+
+    /* Every proper prefix is rejected or parses without reading past it */
+    for (gsize len = 0; len < frame->len; len++) {
+        gchar* prefix = g_memdup2(frame->str, len);
+        signaling_parse_binary(prefix, len, &msg);
+        g_free(prefix);
+    }
+
+    g_string_free(scratch, TRUE);
+    g_string_free(frame, TRUE);
+}
+
+int
+main(int argc, char** argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/signaling/fast/valid", test_fast_valid);
+    g_test_add_func("/signaling/json/valid", test_json_valid);
+    g_test_add_func("/signaling/text/invalid", test_text_invalid);
+    g_test_add_func("/signaling/text/round-trip", test_text_round_trip);
+    g_test_add_func("/signaling/batch-overflow", test_batch_overflow);
+    g_test_add_func("/signaling/binary/frames", test_binary);
+    g_test_add_func("/signaling/binary/round-trip", test_binary_round_trip);
+
+    return g_test_run();
+}